@@ -1,25 +1,47 @@
 #include "config.h"
 #include <ba/ba.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #ifdef _WIN32
 #include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
 #else
 #include <dirent.h>
 #include <sys/stat.h>
 #endif
 
 static void print_help(const char *arg0) {
-  fprintf(stderr, "Usage: %s <OPERATION> <ARCHIVE_FILE> <ENTRIES>...\n", arg0);
+  fprintf(stderr,
+          "Usage: %s <OPERATION> [OPTIONS] <ARCHIVE_FILE> <ENTRIES>...\n",
+          arg0);
   fprintf(stderr, "\n");
   fprintf(stderr, "OPERATION:\n");
   fprintf(stderr, "  h  Print helpful message.\n");
   fprintf(stderr, "  v  Print version information.\n");
   fprintf(stderr, "  c  Create archive file.\n");
+  fprintf(stderr, "  u  Add or replace entries in archive file.\n");
   fprintf(stderr, "  l  List entries from archive file.\n");
   fprintf(stderr, "  x  Extract entries from archive file.\n");
+  fprintf(stderr, "  compact  Reclaim space left by replaced entries.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "OPTIONS (c, u):\n");
+  fprintf(stderr, "  -j N  Compress entries on N threads (1-1024).\n");
+  fprintf(stderr, "  -z N  Use zlib level N (0-9, 0 stores as is).\n");
+  fprintf(stderr, "  -r F  Reuse unchanged entries from archive F.\n");
+  fprintf(stderr, "  -a N  Align every payload to N bytes.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "OPTIONS (c):\n");
+  fprintf(stderr, "  -d N  Train a shared dictionary of N bytes (<= 32768).\n");
+  fprintf(stderr, "  -s N  Pack small entries into solid blocks of N bytes.\n");
+  fprintf(stderr, "  --order F  Lay out entries in the order listed in F.\n");
+  fprintf(stderr, "  --preload F  Store entries listed in F first.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "An ARCHIVE_FILE of '-' writes the archive to stdout.\n");
   fprintf(stderr, "\n");
 }
 
@@ -34,6 +56,21 @@ static void print_version(const char *arg0) {
           BA_VERSION_MINOR(lib_version), BA_VERSION_PATCH(lib_version));
 }
 
+static uint64_t parse_option(const char *arg0, const char *opt,
+                             const char *str, uint64_t min, uint64_t max) {
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(str, &end, 10);
+  if (str[0] < '0' || str[0] > '9' || *end != '\0' || errno != 0 ||
+      value < min || value > max) {
+    fprintf(stderr, "Invalid value for '%s': '%s'.\n", opt, str);
+    print_help(arg0);
+    exit(1);
+  }
+
+  return value;
+}
+
 static int add_files(ba_writer_t *wr, const char *name) {
 #ifdef _WIN32
   WIN32_FIND_DATA ffd;
@@ -44,6 +81,9 @@ static int add_files(ba_writer_t *wr, const char *name) {
 
   hFind = FindFirstFile(qp, &ffd);
   if (hFind == INVALID_HANDLE_VALUE) {
+    if (ba_writer_add_file(wr, name) == 0)
+      return 0;
+
     perror(name);
     return -1;
   }
@@ -72,6 +112,9 @@ static int add_files(ba_writer_t *wr, const char *name) {
 #else
   DIR *dir = opendir(name);
   if (dir == NULL) {
+    if (ba_writer_add_file(wr, name) == 0)
+      return 0;
+
     perror(name);
     return -1;
   }
@@ -114,6 +157,28 @@ int main(int argc, char **argv) {
     exit(0);
   }
 
+  if (strcmp(argv[1], "compact") == 0) {
+    if (argc < 3) {
+      print_help(argv[0]);
+      exit(1);
+    }
+
+    ba_writer_t *wr = NULL;
+    if (ba_writer_alloc(&wr) < 0) {
+      perror("ba_writer_alloc");
+      exit(1);
+    }
+
+    if (ba_writer_compact_file(wr, argv[2]) < 0) {
+      perror(argv[2]);
+      exit(1);
+    }
+
+    ba_writer_free(&wr);
+
+    exit(0);
+  }
+
   switch (argv[1][0]) {
   case 'h':
     print_help(argv[0]);
@@ -123,8 +188,65 @@ int main(int argc, char **argv) {
     print_version(argv[0]);
     exit(0);
 
-  case 'c': {
-    if (argc < 3) {
+  case 'c':
+  case 'u': {
+    uint32_t threads = 1;
+    int level = -1;
+    uint32_t dict_size = 0;
+    uint64_t solid_size = 0;
+    const char *previous = NULL;
+    uint64_t alignment = 0;
+    const char *order = NULL;
+    const char *preload = NULL;
+
+    int arg = 2;
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+      /* An update keeps the archive's dictionary and solid blocks and appends
+       * its entries after the existing payloads. */
+      if (argv[1][0] == 'u' &&
+          (strcmp(argv[arg], "-d") == 0 || strcmp(argv[arg], "-s") == 0 ||
+           strcmp(argv[arg], "--order") == 0 ||
+           strcmp(argv[arg], "--preload") == 0)) {
+        fprintf(stderr, "Option '%s' cannot be used with 'u'.\n", argv[arg]);
+        print_help(argv[0]);
+        exit(1);
+      }
+
+      if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+        threads = parse_option(argv[0], argv[arg], argv[arg + 1], 1, 1024);
+        arg += 2;
+      } else if (strcmp(argv[arg], "-z") == 0 && arg + 1 < argc) {
+        level = parse_option(argv[0], argv[arg], argv[arg + 1], 0, 9);
+        arg += 2;
+      } else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+        dict_size =
+            parse_option(argv[0], argv[arg], argv[arg + 1], 0, 32768);
+        arg += 2;
+      } else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+        solid_size =
+            parse_option(argv[0], argv[arg], argv[arg + 1], 0, UINT32_MAX);
+        arg += 2;
+      } else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+        previous = argv[arg + 1];
+        arg += 2;
+      } else if (strcmp(argv[arg], "-a") == 0 && arg + 1 < argc) {
+        alignment =
+            parse_option(argv[0], argv[arg], argv[arg + 1], 0, UINT32_MAX);
+        arg += 2;
+      } else if (strcmp(argv[arg], "--order") == 0 && arg + 1 < argc) {
+        order = argv[arg + 1];
+        arg += 2;
+      } else if (strcmp(argv[arg], "--preload") == 0 && arg + 1 < argc) {
+        preload = argv[arg + 1];
+        arg += 2;
+      } else {
+        fprintf(stderr, "Unknown option: '%s'.\n", argv[arg]);
+        print_help(argv[0]);
+        exit(1);
+      }
+    }
+
+    if (argc < arg + 1) {
       print_help(argv[0]);
       exit(1);
     }
@@ -135,13 +257,83 @@ int main(int argc, char **argv) {
       exit(1);
     }
 
-    for (int i = 3; i < argc; i++) {
+    if (ba_writer_set_threads(wr, threads) < 0) {
+      perror("ba_writer_set_threads");
+      exit(1);
+    }
+
+    if (ba_writer_set_codec(wr, level == 0 ? BA_CODEC_STORE : BA_CODEC_DEFLATE,
+                            level) < 0) {
+      perror("ba_writer_set_codec");
+      exit(1);
+    }
+
+    if (ba_writer_set_dictionary_size(wr, dict_size) < 0) {
+      perror("ba_writer_set_dictionary_size");
+      exit(1);
+    }
+
+    if (ba_writer_set_solid_size(wr, solid_size) < 0) {
+      perror("ba_writer_set_solid_size");
+      exit(1);
+    }
+
+    if (ba_writer_set_previous_file(wr, previous) < 0) {
+      perror("ba_writer_set_previous_file");
+      exit(1);
+    }
+
+    if (ba_writer_set_alignment(wr, alignment) < 0) {
+      perror("ba_writer_set_alignment");
+      exit(1);
+    }
+
+    if (ba_writer_set_order_file(wr, order) < 0) {
+      perror("ba_writer_set_order_file");
+      exit(1);
+    }
+
+    if (ba_writer_set_preload_file(wr, preload) < 0) {
+      perror("ba_writer_set_preload_file");
+      exit(1);
+    }
+
+    for (int i = arg + 1; i < argc; i++) {
       if (add_files(wr, argv[i]) < 0) {
         continue;
       }
     }
 
-    if (ba_writer_write_file(wr, argv[2]) < 0) {
+    if (argv[1][0] == 'u') {
+      if (ba_writer_update_file(wr, argv[arg]) < 0) {
+        perror("ba_writer_update_file");
+        exit(1);
+      }
+    } else if (strcmp(argv[arg], "-") == 0) {
+#ifdef _WIN32
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+      ba_buffer_t *buf;
+      if (ba_buffer_init_fp(&buf, stdout) < 0) {
+        perror("ba_buffer_init_fp");
+        exit(1);
+      }
+
+      if (ba_writer_set_trailing_index(wr, 1) < 0 ||
+          ba_writer_write(wr, buf) < 0) {
+        perror("ba_writer_write");
+        exit(1);
+      }
+
+      /* Freeing the buffer closes stdout and drops any error, so check that
+       * the archive reached it first. */
+      if (fflush(stdout) != 0 || ferror(stdout)) {
+        perror("stdout");
+        exit(1);
+      }
+
+      ba_buffer_free(&buf);
+    } else if (ba_writer_write_file(wr, argv[arg]) < 0) {
       perror("ba_writer_write");
       exit(1);
     }
@@ -177,10 +369,15 @@ int main(int argc, char **argv) {
       ba_reader_entry_name(rd, id, &name, &len);
       uint64_t esize = ba_reader_entry_size(rd, id);
 
-      fprintf(stdout, "\"%.*s\": %llu\n", (int)len, name, esize);
+      fprintf(stdout, "\"%.*s\": %" PRIu64 "\n", (int)len, name, esize);
     }
 
+    fprintf(stdout, "Dedup Saved: %" PRIu64 "\n", ba_reader_dedup_size(rd));
+    fprintf(stdout, "Dead Bytes: %" PRIu64 "\n", ba_reader_dead_size(rd));
+
     ba_reader_free(&rd);
+
+    exit(0);
   }
 
   case 'x': {
@@ -3,6 +3,7 @@
 
 #include "exports.h"
 #include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,6 +19,8 @@ BA_API int ba_buffer_init_mem(ba_buffer_t **buf, const void *ptr,
 BA_API int ba_buffer_init_file(ba_buffer_t **buf, const char *filename,
                                const char *mode);
 
+BA_API int ba_buffer_init_fp(ba_buffer_t **buf, FILE *fp);
+
 BA_API void ba_buffer_free(ba_buffer_t **buf);
 
 BA_API int ba_buffer_seek(ba_buffer_t *buf, int64_t pos, int whence);
@@ -26,10 +29,21 @@ BA_API int64_t ba_buffer_tell(ba_buffer_t *buf);
 
 BA_API uint64_t ba_buffer_read(ba_buffer_t *buf, void *ptr, uint64_t size);
 
+BA_API uint64_t ba_buffer_pread(ba_buffer_t *buf, void *ptr, uint64_t size,
+                                uint64_t pos);
+
 BA_API int ba_buffer_write(ba_buffer_t *buf, const void *ptr, uint64_t size);
 
 BA_API uint64_t ba_buffer_size(ba_buffer_t *buf);
 
+BA_API int ba_buffer_reserve(ba_buffer_t *buf, uint64_t size);
+
+BA_API int ba_buffer_shrink_to_fit(ba_buffer_t *buf);
+
+BA_API int ba_buffer_detach(ba_buffer_t *buf, void **ptr, uint64_t *size);
+
+BA_API void ba_buffer_free_data(void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,6 +36,8 @@ public:
     return ba_buffer_init_file(&buf, filename.c_str(), mode.c_str());
   }
 
+  bool Init(FILE *fp) { return ba_buffer_init_fp(&buf, fp) == 0; }
+
   bool Seek(int64_t pos, int whence) {
     return ba_buffer_seek(buf, pos, whence) == 0;
   }
@@ -46,12 +48,27 @@ public:
     return ba_buffer_read(buf, ptr, size);
   }
 
+  uint64_t PRead(void *ptr, uint64_t size, uint64_t pos) {
+    return ba_buffer_pread(buf, ptr, size, pos);
+  }
+
   int Write(const void *ptr, uint64_t size) {
     return ba_buffer_write(buf, ptr, size) == 0;
   }
 
   uint64_t Size() { return ba_buffer_size(buf); }
 
+  bool Reserve(uint64_t size) { return ba_buffer_reserve(buf, size) == 0; }
+
+  bool ShrinkToFit() { return ba_buffer_shrink_to_fit(buf) == 0; }
+
+  void *Detach(uint64_t &size) {
+    void *ptr;
+    if (ba_buffer_detach(buf, &ptr, &size) != 0)
+      return nullptr;
+    return ptr;
+  }
+
 private:
   ba_buffer_t *buf;
 
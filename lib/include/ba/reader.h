@@ -11,15 +11,66 @@ extern "C" {
 
 typedef struct ba_reader ba_reader_t;
 
+typedef struct ba_entry_stream ba_entry_stream_t;
+
+typedef struct ba_read_request ba_read_request_t;
+
 typedef uint32_t ba_id_t;
 
 #define BA_ENTRY_INVALID ((ba_id_t)~0)
 
+typedef void (*ba_read_callback)(void *arg, ba_id_t id, int err);
+
+#define BA_READER_LAZY 0x1
+#define BA_READER_PRELOAD 0x2
+#define BA_READER_PRELOAD_DECODE 0x4
+
+/*
+ * Once opened, a reader may be shared between threads: everything below
+ * except ba_reader_open*, ba_reader_set_trace, ba_reader_set_threads,
+ * ba_reader_set_cache and ba_reader_free can be called concurrently on the
+ * same reader. Each call keeps its decompression state to itself. An entry
+ * stream must not be used by two threads at once.
+ *
+ * ba_reader_read_batch reads ids[i] into ptrs[i] in payload order. With
+ * ba_reader_set_threads above 1 it decodes on the reader's worker pool (see
+ * below) and waits, otherwise on the calling thread. When errs is not NULL,
+ * errs[i] receives 0 or the errno of that entry.
+ *
+ * ba_reader_read_async queues a read on worker threads owned by the reader
+ * (ba_reader_set_threads of them, at least one) and returns at once. On
+ * completion cb, if given, runs on a worker with err 0 or an errno value.
+ * With req set, the request can also be polled or waited on, and must be
+ * freed with ba_read_request_free. Otherwise it is freed after cb returns.
+ * Free every request before freeing the reader; pending reads are finished
+ * first.
+ *
+ * Queued reads run highest priority first, then by earliest deadline
+ * (timeout milliseconds after submission, 0 for none), then in submission
+ * order. A worker also takes queued reads whose payloads lie next to the one
+ * it picked and fetches them with one I/O. A read still queued can be
+ * cancelled, which completes it with ECANCELED, or given a new priority; both
+ * fail with EBUSY once the read has started. ba_reader_async_stats counts
+ * completed and cancelled reads, late ones (not started by their deadline),
+ * and reads merged into another's I/O.
+ *
+ * ba_reader_set_cache keeps up to budget bytes of decompressed entries,
+ * evicting the least recently used; an entry larger than the whole budget is
+ * never cached. ba_reader_read_cached hands out a view of the decompressed
+ * entry that stays valid until it is passed to ba_reader_release_cached, even
+ * if the cache evicts it meanwhile. Release every view before freeing the
+ * reader.
+ */
+
 BA_API int ba_reader_alloc(ba_reader_t **rd);
 BA_API void ba_reader_free(ba_reader_t **rd);
 
 BA_API int ba_reader_open(ba_reader_t *rd, ba_buffer_t *buf);
 BA_API int ba_reader_open_file(ba_reader_t *rd, const char *filename);
+BA_API int ba_reader_open_ex(ba_reader_t *rd, ba_buffer_t *buf,
+                             uint32_t flags);
+BA_API int ba_reader_open_file_ex(ba_reader_t *rd, const char *filename,
+                                  uint32_t flags);
 
 BA_API uint32_t ba_reader_size(const ba_reader_t *rd);
 
@@ -31,8 +82,55 @@ BA_API int ba_reader_entry_name(const ba_reader_t *rd, ba_id_t id,
 
 BA_API uint64_t ba_reader_entry_size(const ba_reader_t *rd, ba_id_t id);
 
+BA_API uint64_t ba_reader_dedup_size(const ba_reader_t *rd);
+BA_API uint64_t ba_reader_dead_size(const ba_reader_t *rd);
+
+BA_API int ba_reader_set_trace(ba_reader_t *rd, int enable);
+BA_API int ba_reader_write_trace(ba_reader_t *rd, ba_buffer_t *buf);
+BA_API int ba_reader_write_trace_file(ba_reader_t *rd, const char *filename);
+
+BA_API int ba_reader_entry_data(const ba_reader_t *rd, ba_id_t id,
+                                const void **ptr);
+
 BA_API int ba_reader_read(ba_reader_t *rd, ba_id_t id, void *ptr);
 
+BA_API int ba_reader_read_range(ba_reader_t *rd, ba_id_t id, uint64_t offset,
+                                uint64_t len, void *ptr);
+
+BA_API int ba_reader_set_threads(ba_reader_t *rd, uint32_t threads);
+BA_API int ba_reader_read_batch(ba_reader_t *rd, const ba_id_t *ids,
+                                uint32_t count, void *const *ptrs, int *errs);
+
+BA_API int ba_reader_read_async(ba_reader_t *rd, ba_id_t id, void *ptr,
+                                ba_read_callback cb, void *arg,
+                                ba_read_request_t **req);
+BA_API int ba_reader_read_async_ex(ba_reader_t *rd, ba_id_t id, void *ptr,
+                                   int32_t priority, uint32_t timeout,
+                                   ba_read_callback cb, void *arg,
+                                   ba_read_request_t **req);
+BA_API int ba_reader_async_stats(ba_reader_t *rd, uint64_t *completed,
+                                 uint64_t *canceled, uint64_t *late,
+                                 uint64_t *merged);
+BA_API int ba_read_request_cancel(ba_read_request_t *req);
+BA_API int ba_read_request_set_priority(ba_read_request_t *req,
+                                        int32_t priority);
+BA_API int ba_read_request_poll(ba_read_request_t *req);
+BA_API int ba_read_request_wait(ba_read_request_t *req);
+BA_API void ba_read_request_free(ba_read_request_t **req);
+
+BA_API int ba_reader_set_cache(ba_reader_t *rd, uint64_t budget);
+BA_API int ba_reader_cache_stats(const ba_reader_t *rd, uint64_t *hits,
+                                 uint64_t *misses, uint64_t *bytes);
+BA_API int ba_reader_read_cached(ba_reader_t *rd, ba_id_t id,
+                                 const void **ptr);
+BA_API void ba_reader_release_cached(ba_reader_t *rd, const void *ptr);
+
+BA_API int ba_entry_stream_open(ba_reader_t *rd, ba_id_t id,
+                                ba_entry_stream_t **st);
+BA_API uint64_t ba_entry_stream_read(ba_entry_stream_t *st, void *ptr,
+                                     uint64_t size);
+BA_API void ba_entry_stream_close(ba_entry_stream_t **st);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,7 +4,98 @@
 #include "buffer.hpp"
 #include "reader.h"
 
+#if __cplusplus >= 202002L
+#include <cerrno>
+#include <coroutine>
+#include <optional>
+#include <span>
+#endif
+
 namespace ba {
+#if __cplusplus >= 202002L
+class ReadAwaitable {
+public:
+  ReadAwaitable(ba_reader_t *rd, ba_id_t id, void *ptr, int32_t priority,
+                uint32_t timeout)
+      : rd(rd), id(id), ptr(ptr), priority(priority), timeout(timeout),
+        err(0) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+    if (ba_reader_read_async_ex(rd, id, ptr, priority, timeout, Resume, this,
+                                nullptr) != 0) {
+      err = errno;
+      return false;
+    }
+    return true;
+  }
+
+  bool await_resume() const noexcept { return err == 0; }
+
+private:
+  static void Resume(void *arg, ba_id_t, int err) {
+    ReadAwaitable *self = static_cast<ReadAwaitable *>(arg);
+    self->err = err;
+    self->handle.resume();
+  }
+
+  ba_reader_t *rd;
+  ba_id_t id;
+  void *ptr;
+  int32_t priority;
+  uint32_t timeout;
+  int err;
+  std::coroutine_handle<> handle;
+};
+
+class ReadEntryAwaitable {
+public:
+  ReadEntryAwaitable(ba_reader_t *rd, ba_id_t id, int32_t priority,
+                     uint32_t timeout)
+      : rd(rd), id(id), priority(priority), timeout(timeout), err(0) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+    if (id >= ba_reader_size(rd)) {
+      err = EINVAL;
+      return false;
+    }
+    data.resize(ba_reader_entry_size(rd, id));
+    if (ba_reader_read_async_ex(rd, id, data.data(), priority, timeout, Resume,
+                                this, nullptr) != 0) {
+      err = errno;
+      return false;
+    }
+    return true;
+  }
+
+  std::optional<std::string> await_resume() {
+    if (err != 0)
+      return std::nullopt;
+    return std::move(data);
+  }
+
+private:
+  static void Resume(void *arg, ba_id_t, int err) {
+    ReadEntryAwaitable *self = static_cast<ReadEntryAwaitable *>(arg);
+    self->err = err;
+    self->handle.resume();
+  }
+
+  ba_reader_t *rd;
+  ba_id_t id;
+  int32_t priority;
+  uint32_t timeout;
+  int err;
+  std::string data;
+  std::coroutine_handle<> handle;
+};
+#endif
+
 class Reader {
 public:
   Reader() : rd(nullptr) {}
@@ -26,10 +117,12 @@ public:
 
   bool operator!() const { return rd == nullptr; }
 
-  bool Open(Buffer &buf) { return ba_reader_open(rd, buf.buf) == 0; }
+  bool Open(Buffer &buf, uint32_t flags = 0) {
+    return ba_reader_open_ex(rd, buf.buf, flags) == 0;
+  }
 
-  bool Open(const std::string &filename) {
-    return ba_reader_open_file(rd, filename.c_str()) == 0;
+  bool Open(const std::string &filename, uint32_t flags = 0) {
+    return ba_reader_open_file_ex(rd, filename.c_str(), flags) == 0;
   }
 
   uint32_t Size() const { return ba_reader_size(rd); }
@@ -48,10 +141,179 @@ public:
 
   uint64_t EntrySize(ba_id_t id) const { return ba_reader_entry_size(rd, id); }
 
+  uint64_t DedupSize() const { return ba_reader_dedup_size(rd); }
+
+  uint64_t DeadSize() const { return ba_reader_dead_size(rd); }
+
+  bool SetTrace(bool enable) { return ba_reader_set_trace(rd, enable) == 0; }
+
+  bool WriteTrace(Buffer &buf) {
+    return ba_reader_write_trace(rd, buf.buf) == 0;
+  }
+
+  bool WriteTrace(const std::string &filename) {
+    return ba_reader_write_trace_file(rd, filename.c_str()) == 0;
+  }
+
+  const void *EntryData(ba_id_t id) const {
+    const void *ptr;
+    if (ba_reader_entry_data(rd, id, &ptr) != 0)
+      return nullptr;
+    return ptr;
+  }
+
   bool Read(ba_id_t id, void *ptr) { return ba_reader_read(rd, id, ptr) == 0; }
 
+  bool ReadRange(ba_id_t id, uint64_t offset, uint64_t len, void *ptr) {
+    return ba_reader_read_range(rd, id, offset, len, ptr) == 0;
+  }
+
+  bool SetThreads(uint32_t threads) {
+    return ba_reader_set_threads(rd, threads) == 0;
+  }
+
+  bool ReadBatch(const ba_id_t *ids, uint32_t count, void *const *ptrs,
+                 int *errs = nullptr) {
+    return ba_reader_read_batch(rd, ids, count, ptrs, errs) == 0;
+  }
+
+#if __cplusplus >= 202002L
+  bool ReadBatch(std::span<const ba_id_t> ids, std::span<void *const> ptrs,
+                 std::span<int> errs = {}) {
+    if (ptrs.size() != ids.size() ||
+        (!errs.empty() && errs.size() != ids.size()) ||
+        ids.size() > UINT32_MAX)
+      return false;
+    return ba_reader_read_batch(rd, ids.data(), (uint32_t)ids.size(),
+                                ptrs.data(),
+                                errs.empty() ? nullptr : errs.data()) == 0;
+  }
+#endif
+
+#if __cplusplus >= 202002L
+  ReadAwaitable ReadAsync(ba_id_t id, void *ptr, int32_t priority = 0,
+                          uint32_t timeout = 0) {
+    return {rd, id, ptr, priority, timeout};
+  }
+
+  ReadEntryAwaitable ReadAsync(ba_id_t id, int32_t priority = 0,
+                               uint32_t timeout = 0) {
+    return {rd, id, priority, timeout};
+  }
+#endif
+
+  bool AsyncStats(uint64_t &completed, uint64_t &canceled, uint64_t &late,
+                  uint64_t &merged) {
+    return ba_reader_async_stats(rd, &completed, &canceled, &late, &merged) ==
+           0;
+  }
+
+  bool SetCache(uint64_t budget) {
+    return ba_reader_set_cache(rd, budget) == 0;
+  }
+
+  bool CacheStats(uint64_t &hits, uint64_t &misses, uint64_t &bytes) const {
+    return ba_reader_cache_stats(rd, &hits, &misses, &bytes) == 0;
+  }
+
+private:
+  ba_reader_t *rd;
+
+  friend class EntryStream;
+  friend class EntryView;
+};
+
+class EntryView {
+public:
+  EntryView() : rd(nullptr), ptr(nullptr), size(0) {}
+
+  EntryView(EntryView &&rhs) noexcept
+      : rd(rhs.rd), ptr(rhs.ptr), size(rhs.size) {
+    rhs.rd = nullptr;
+    rhs.ptr = nullptr;
+    rhs.size = 0;
+  }
+
+  EntryView &operator=(EntryView &&rhs) noexcept {
+    if (this != &rhs) {
+      Close();
+      rd = rhs.rd;
+      ptr = rhs.ptr;
+      size = rhs.size;
+      rhs.rd = nullptr;
+      rhs.ptr = nullptr;
+      rhs.size = 0;
+    }
+    return *this;
+  }
+
+  ~EntryView() { Close(); }
+
+  operator bool() const { return ptr != nullptr; }
+
+  bool operator!() const { return ptr == nullptr; }
+
+  bool Open(Reader &reader, ba_id_t id) {
+    Close();
+    if (ba_reader_read_cached(reader.rd, id, &ptr) != 0)
+      return false;
+    rd = reader.rd;
+    size = ba_reader_entry_size(rd, id);
+    return true;
+  }
+
+  const void *Data() const { return ptr; }
+
+  uint64_t Size() const { return size; }
+
+  void Close() {
+    if (ptr != nullptr)
+      ba_reader_release_cached(rd, ptr);
+    rd = nullptr;
+    ptr = nullptr;
+    size = 0;
+  }
+
 private:
   ba_reader_t *rd;
+  const void *ptr;
+  uint64_t size;
+};
+
+class EntryStream {
+public:
+  EntryStream() : st(nullptr) {}
+
+  EntryStream(EntryStream &&rhs) noexcept : st(rhs.st) { rhs.st = nullptr; }
+
+  EntryStream &operator=(EntryStream &&rhs) noexcept {
+    if (this != &rhs) {
+      ba_entry_stream_close(&st);
+      st = rhs.st;
+      rhs.st = nullptr;
+    }
+    return *this;
+  }
+
+  ~EntryStream() { ba_entry_stream_close(&st); }
+
+  operator bool() const { return st != nullptr; }
+
+  bool operator!() const { return st == nullptr; }
+
+  bool Open(Reader &rd, ba_id_t id) {
+    ba_entry_stream_close(&st);
+    return ba_entry_stream_open(rd.rd, id, &st) == 0;
+  }
+
+  uint64_t Read(void *ptr, uint64_t size) {
+    return ba_entry_stream_read(st, ptr, size);
+  }
+
+  void Close() { ba_entry_stream_close(&st); }
+
+private:
+  ba_entry_stream_t *st;
 };
 } // namespace ba
 
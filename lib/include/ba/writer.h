@@ -11,15 +11,35 @@ extern "C" {
 
 typedef struct ba_writer ba_writer_t;
 
+#define BA_CODEC_DEFLATE 0
+#define BA_CODEC_STORE 1
+
 BA_API int ba_writer_alloc(ba_writer_t **wr);
 BA_API void ba_writer_free(ba_writer_t **wr);
 
+BA_API int ba_writer_set_hash_index(ba_writer_t *wr, int enable);
+BA_API int ba_writer_set_block_size(ba_writer_t *wr, uint64_t size);
+BA_API int ba_writer_set_threads(ba_writer_t *wr, uint32_t threads);
+BA_API int ba_writer_set_buffer_size(ba_writer_t *wr, uint64_t size);
+BA_API int ba_writer_set_trailing_index(ba_writer_t *wr, int enable);
+BA_API int ba_writer_set_codec(ba_writer_t *wr, uint32_t codec, int level);
+BA_API int ba_writer_set_store_threshold(ba_writer_t *wr, uint32_t percent);
+BA_API int ba_writer_set_dedup(ba_writer_t *wr, int enable);
+BA_API int ba_writer_set_dictionary_size(ba_writer_t *wr, uint32_t size);
+BA_API int ba_writer_set_solid_size(ba_writer_t *wr, uint64_t size);
+BA_API int ba_writer_set_previous_file(ba_writer_t *wr, const char *filename);
+BA_API int ba_writer_set_alignment(ba_writer_t *wr, uint64_t alignment);
+BA_API int ba_writer_set_order_file(ba_writer_t *wr, const char *filename);
+BA_API int ba_writer_set_preload_file(ba_writer_t *wr, const char *filename);
+
 BA_API int ba_writer_add(ba_writer_t *wr, const char *entry, uint64_t entry_len,
                          ba_buffer_t *buf);
 BA_API int ba_writer_add_file(ba_writer_t *wr, const char *filename);
 
 BA_API int ba_writer_write(ba_writer_t *wr, ba_buffer_t *buf);
 BA_API int ba_writer_write_file(ba_writer_t *wr, const char *filename);
+BA_API int ba_writer_update_file(ba_writer_t *wr, const char *filename);
+BA_API int ba_writer_compact_file(ba_writer_t *wr, const char *filename);
 
 #ifdef __cplusplus
 }
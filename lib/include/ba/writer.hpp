@@ -26,6 +26,60 @@ public:
 
   bool operator!() const { return wr == nullptr; }
 
+  bool SetHashIndex(bool enable) {
+    return ba_writer_set_hash_index(wr, enable) == 0;
+  }
+
+  bool SetBlockSize(uint64_t size) {
+    return ba_writer_set_block_size(wr, size) == 0;
+  }
+
+  bool SetThreads(uint32_t threads) {
+    return ba_writer_set_threads(wr, threads) == 0;
+  }
+
+  bool SetBufferSize(uint64_t size) {
+    return ba_writer_set_buffer_size(wr, size) == 0;
+  }
+
+  bool SetTrailingIndex(bool enable) {
+    return ba_writer_set_trailing_index(wr, enable) == 0;
+  }
+
+  bool SetCodec(uint32_t codec, int level = -1) {
+    return ba_writer_set_codec(wr, codec, level) == 0;
+  }
+
+  bool SetStoreThreshold(uint32_t percent) {
+    return ba_writer_set_store_threshold(wr, percent) == 0;
+  }
+
+  bool SetDedup(bool enable) { return ba_writer_set_dedup(wr, enable) == 0; }
+
+  bool SetDictionarySize(uint32_t size) {
+    return ba_writer_set_dictionary_size(wr, size) == 0;
+  }
+
+  bool SetSolidSize(uint64_t size) {
+    return ba_writer_set_solid_size(wr, size) == 0;
+  }
+
+  bool SetPreviousFile(const std::string &filename) {
+    return ba_writer_set_previous_file(wr, filename.c_str()) == 0;
+  }
+
+  bool SetAlignment(uint64_t alignment) {
+    return ba_writer_set_alignment(wr, alignment) == 0;
+  }
+
+  bool SetOrderFile(const std::string &filename) {
+    return ba_writer_set_order_file(wr, filename.c_str()) == 0;
+  }
+
+  bool SetPreloadFile(const std::string &filename) {
+    return ba_writer_set_preload_file(wr, filename.c_str()) == 0;
+  }
+
   bool Add(const std::string &entry, Buffer &&buf) {
     int ret = ba_writer_add(wr, entry.c_str(), entry.length(), buf.buf);
     buf.buf = nullptr;
@@ -42,6 +96,14 @@ public:
     return ba_writer_write_file(wr, filename.c_str()) == 0;
   }
 
+  bool Update(const std::string &filename) {
+    return ba_writer_update_file(wr, filename.c_str()) == 0;
+  }
+
+  bool Compact(const std::string &filename) {
+    return ba_writer_compact_file(wr, filename.c_str()) == 0;
+  }
+
 private:
   ba_writer_t *wr;
 };
@@ -1,3 +1,5 @@
+#include "pipe.h"
+#include "thread.h"
 #include <ba/buffer.h>
 #include <errno.h>
 #include <stdio.h>
@@ -6,13 +8,24 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 struct ba_buffer {
   void (*free)(void *arg);
   int (*seek)(void *arg, int64_t pos, int whence);
   int64_t (*tell)(void *arg);
   uint64_t (*read)(void *arg, void *ptr, uint64_t size);
+  uint64_t (*pread)(void *arg, void *ptr, uint64_t size, uint64_t pos);
   int (*write)(void *arg, const void *ptr, uint64_t size);
   uint64_t (*size)(void *arg);
+  int (*reserve)(void *arg, uint64_t size);
+  int (*shrink)(void *arg);
+  int (*detach)(void *arg, void **ptr, uint64_t *size);
 
   void *arg;
 };
@@ -25,6 +38,7 @@ struct ba_buffer {
     BA_BUF_ASSI(buf, pfx, seek)                                                \
     BA_BUF_ASSI(buf, pfx, tell)                                                \
     BA_BUF_ASSI(buf, pfx, read)                                                \
+    BA_BUF_ASSI(buf, pfx, pread)                                               \
     BA_BUF_ASSI(buf, pfx, write)                                               \
     BA_BUF_ASSI(buf, pfx, size)                                                \
   } while (0)
@@ -32,9 +46,12 @@ struct ba_buffer {
 struct ba_buffer_ctx_mem {
   void *ptr;
   uint64_t size;
+  uint64_t cap;
   uint64_t curr;
 };
 
+#define BA_MEM_MIN_CAP 64
+
 static void mem_free(void *arg) {
   struct ba_buffer_ctx_mem *ctx = arg;
 
@@ -42,6 +59,81 @@ static void mem_free(void *arg) {
   free(ctx);
 }
 
+static int mem_reserve(void *arg, uint64_t size) {
+  struct ba_buffer_ctx_mem *ctx = arg;
+
+  if (size <= ctx->cap)
+    return 0;
+
+  void *new_ptr = realloc(ctx->ptr, size);
+  if (new_ptr == NULL)
+    return -1;
+  ctx->ptr = new_ptr;
+  ctx->cap = size;
+
+  return 0;
+}
+
+static int mem_grow(struct ba_buffer_ctx_mem *ctx, uint64_t size) {
+  if (size <= ctx->cap)
+    return 0;
+
+  uint64_t new_cap = ctx->cap < BA_MEM_MIN_CAP ? BA_MEM_MIN_CAP : ctx->cap;
+  while (new_cap < size)
+    new_cap = new_cap > UINT64_MAX / 2 ? size : new_cap * 2;
+
+  return mem_reserve(ctx, new_cap);
+}
+
+static int mem_extend(struct ba_buffer_ctx_mem *ctx, uint64_t size) {
+  if (size <= ctx->size)
+    return 0;
+
+  if (mem_grow(ctx, size) < 0)
+    return -1;
+
+  memset(&((char *)ctx->ptr)[ctx->size], 0, size - ctx->size);
+  ctx->size = size;
+
+  return 0;
+}
+
+static int mem_shrink(void *arg) {
+  struct ba_buffer_ctx_mem *ctx = arg;
+
+  if (ctx->cap == ctx->size)
+    return 0;
+
+  if (ctx->size == 0) {
+    free(ctx->ptr);
+    ctx->ptr = NULL;
+    ctx->cap = 0;
+    return 0;
+  }
+
+  void *new_ptr = realloc(ctx->ptr, ctx->size);
+  if (new_ptr == NULL)
+    return -1;
+  ctx->ptr = new_ptr;
+  ctx->cap = ctx->size;
+
+  return 0;
+}
+
+static int mem_detach(void *arg, void **ptr, uint64_t *size) {
+  struct ba_buffer_ctx_mem *ctx = arg;
+
+  *ptr = ctx->ptr;
+  *size = ctx->size;
+
+  ctx->ptr = NULL;
+  ctx->size = 0;
+  ctx->cap = 0;
+  ctx->curr = 0;
+
+  return 0;
+}
+
 static int mem_seek(void *arg, int64_t pos, int whence) {
   struct ba_buffer_ctx_mem *ctx = arg;
 
@@ -52,16 +144,8 @@ static int mem_seek(void *arg, int64_t pos, int whence) {
       return -1;
     }
 
-    if (pos > ctx->size) {
-      uint64_t new_size = pos;
-      void *new_ptr = realloc(ctx->ptr, new_size);
-      if (new_ptr == NULL) {
-        return -1;
-      }
-      memset(&((char *)ctx->ptr)[ctx->size], 0, new_size - ctx->size);
-      ctx->ptr = new_ptr;
-      ctx->size = new_size;
-    }
+    if (mem_extend(ctx, pos) < 0)
+      return -1;
 
     ctx->curr = pos;
 
@@ -73,16 +157,8 @@ static int mem_seek(void *arg, int64_t pos, int whence) {
       return -1;
     }
 
-    if (pos + ctx->curr > ctx->size) {
-      uint64_t new_size = pos + ctx->curr;
-      void *new_ptr = realloc(ctx->ptr, new_size);
-      if (new_ptr == NULL) {
-        return -1;
-      }
-      memset(&((char *)ctx->ptr)[ctx->size], 0, new_size - ctx->size);
-      ctx->ptr = new_ptr;
-      ctx->size = new_size;
-    }
+    if (mem_extend(ctx, pos + ctx->curr) < 0)
+      return -1;
 
     ctx->curr = pos + ctx->curr;
 
@@ -94,16 +170,8 @@ static int mem_seek(void *arg, int64_t pos, int whence) {
       return -1;
     }
 
-    if (pos > 0) {
-      uint64_t new_size = pos + ctx->size;
-      void *new_ptr = realloc(ctx->ptr, new_size);
-      if (new_ptr == NULL) {
-        return -1;
-      }
-      memset(&((char *)ctx->ptr)[ctx->size], 0, new_size - ctx->size);
-      ctx->ptr = new_ptr;
-      ctx->size = new_size;
-    }
+    if (mem_extend(ctx, pos + ctx->size) < 0)
+      return -1;
 
     ctx->curr = pos + ctx->size;
 
@@ -133,20 +201,30 @@ static uint64_t mem_read(void *arg, void *ptr, uint64_t size) {
   return size;
 }
 
+static uint64_t mem_pread(void *arg, void *ptr, uint64_t size, uint64_t pos) {
+  struct ba_buffer_ctx_mem *ctx = arg;
+
+  if (pos >= ctx->size)
+    return 0;
+
+  if (size > ctx->size - pos)
+    size = ctx->size - pos;
+
+  memcpy(ptr, &((char *)ctx->ptr)[pos], size);
+
+  return size;
+}
+
 static int mem_write(void *arg, const void *ptr, uint64_t size) {
   struct ba_buffer_ctx_mem *ctx = arg;
 
-  if (ctx->curr + size > ctx->size) {
-    uint64_t new_size = ctx->curr + size;
-    void *new_ptr = realloc(ctx->ptr, new_size);
-    if (new_ptr == NULL)
-      return -1;
-    ctx->ptr = new_ptr;
-    ctx->size = new_size;
-  }
+  if (mem_grow(ctx, ctx->curr + size) < 0)
+    return -1;
 
   memcpy(&((char *)ctx->ptr)[ctx->curr], ptr, size);
   ctx->curr += size;
+  if (ctx->curr > ctx->size)
+    ctx->size = ctx->curr;
 
   return 0;
 }
@@ -189,6 +267,59 @@ static uint64_t fp_read(void *arg, void *ptr, uint64_t size) {
   return fread(ptr, 1, size, fp);
 }
 
+static uint64_t fp_pread(void *arg, void *ptr, uint64_t size, uint64_t pos) {
+  FILE *fp = arg;
+
+#ifdef _WIN32
+  HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+  if (file == INVALID_HANDLE_VALUE) {
+    errno = EBADF;
+    return ~0ULL;
+  }
+
+  uint64_t done = 0;
+  while (done < size) {
+    DWORD chunk =
+        size - done > 0x40000000 ? 0x40000000 : (DWORD)(size - done);
+    OVERLAPPED ov = {0};
+    ov.Offset = (DWORD)(pos + done);
+    ov.OffsetHigh = (DWORD)((pos + done) >> 32);
+
+    DWORD got;
+    if (!ReadFile(file, &((char *)ptr)[done], chunk, &got, &ov)) {
+      if (GetLastError() == ERROR_HANDLE_EOF)
+        break;
+      errno = EIO;
+      return ~0ULL;
+    }
+    if (got == 0)
+      break;
+    done += got;
+  }
+
+  return done;
+#else
+  int fd = fileno(fp);
+  if (fd == -1)
+    return ~0ULL;
+
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t got = pread(fd, &((char *)ptr)[done], size - done, pos + done);
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      return ~0ULL;
+    }
+    if (got == 0)
+      break;
+    done += got;
+  }
+
+  return done;
+#endif
+}
+
 static int fp_write(void *arg, const void *ptr, uint64_t size) {
   FILE *fp = arg;
 
@@ -221,6 +352,126 @@ static uint64_t fp_size(void *arg) {
 #endif
 }
 
+struct ba_buffer_ctx_pipe {
+  ba_mutex_t lock;
+  ba_cond_t cond;
+  uint8_t *ring;
+  uint64_t cap;
+  uint64_t head;
+  uint64_t tail;
+  int closed;
+};
+
+static void pipe_free(void *arg) {
+  struct ba_buffer_ctx_pipe *ctx = arg;
+
+  ba_cond_destroy(&ctx->cond);
+  ba_mutex_destroy(&ctx->lock);
+  free(ctx->ring);
+  free(ctx);
+}
+
+static int pipe_seek(void *arg, int64_t pos, int whence) {
+  (void)arg;
+  (void)pos;
+  (void)whence;
+
+  errno = ESPIPE;
+  return -1;
+}
+
+static int64_t pipe_tell(void *arg) {
+  struct ba_buffer_ctx_pipe *ctx = arg;
+
+  ba_mutex_lock(&ctx->lock);
+  uint64_t head = ctx->head;
+  ba_mutex_unlock(&ctx->lock);
+
+  return head;
+}
+
+static uint64_t pipe_read(void *arg, void *ptr, uint64_t size) {
+  struct ba_buffer_ctx_pipe *ctx = arg;
+  uint64_t done = 0;
+
+  ba_mutex_lock(&ctx->lock);
+  while (done < size) {
+    while (ctx->tail == ctx->head && !ctx->closed)
+      ba_cond_wait(&ctx->cond, &ctx->lock);
+    if (ctx->tail == ctx->head)
+      break;
+
+    uint64_t pos = ctx->head % ctx->cap;
+    uint64_t n = ctx->tail - ctx->head;
+    if (n > size - done)
+      n = size - done;
+    if (n > ctx->cap - pos)
+      n = ctx->cap - pos;
+
+    memcpy(&((uint8_t *)ptr)[done], &ctx->ring[pos], n);
+    ctx->head += n;
+    done += n;
+    ba_cond_broadcast(&ctx->cond);
+  }
+  ba_mutex_unlock(&ctx->lock);
+
+  return done;
+}
+
+static uint64_t pipe_pread(void *arg, void *ptr, uint64_t size, uint64_t pos) {
+  (void)arg;
+  (void)ptr;
+  (void)size;
+  (void)pos;
+
+  errno = ESPIPE;
+  return ~0ULL;
+}
+
+static int pipe_write(void *arg, const void *ptr, uint64_t size) {
+  struct ba_buffer_ctx_pipe *ctx = arg;
+  uint64_t done = 0;
+
+  ba_mutex_lock(&ctx->lock);
+  while (!ctx->closed && done < size) {
+    if (ctx->tail - ctx->head == ctx->cap) {
+      ba_cond_wait(&ctx->cond, &ctx->lock);
+      continue;
+    }
+
+    uint64_t pos = ctx->tail % ctx->cap;
+    uint64_t n = ctx->cap - (ctx->tail - ctx->head);
+    if (n > size - done)
+      n = size - done;
+    if (n > ctx->cap - pos)
+      n = ctx->cap - pos;
+
+    memcpy(&ctx->ring[pos], &((const uint8_t *)ptr)[done], n);
+    ctx->tail += n;
+    done += n;
+    ba_cond_broadcast(&ctx->cond);
+  }
+  int closed = ctx->closed;
+  ba_mutex_unlock(&ctx->lock);
+
+  if (closed) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  return 0;
+}
+
+static uint64_t pipe_size(void *arg) {
+  struct ba_buffer_ctx_pipe *ctx = arg;
+
+  ba_mutex_lock(&ctx->lock);
+  uint64_t tail = ctx->tail;
+  ba_mutex_unlock(&ctx->lock);
+
+  return tail;
+}
+
 int ba_buffer_init(ba_buffer_t **buf) {
   if (buf == NULL) {
     errno = EINVAL;
@@ -234,14 +485,19 @@ int ba_buffer_init(ba_buffer_t **buf) {
   struct ba_buffer_ctx_mem *ctx = malloc(sizeof(*ctx));
   if (ctx == NULL) {
     free(*buf);
+    *buf = NULL;
     return -1;
   }
 
   ctx->ptr = NULL;
   ctx->size = 0;
+  ctx->cap = 0;
   ctx->curr = 0;
 
   BA_BUF_INIT(*buf, mem);
+  BA_BUF_ASSI(*buf, mem, reserve)
+  BA_BUF_ASSI(*buf, mem, shrink)
+  BA_BUF_ASSI(*buf, mem, detach)
   (*buf)->arg = ctx;
 
   return 0;
@@ -260,6 +516,7 @@ int ba_buffer_init_mem(ba_buffer_t **buf, const void *ptr, uint64_t size) {
   struct ba_buffer_ctx_mem *ctx = malloc(sizeof(*ctx));
   if (ctx == NULL) {
     free(*buf);
+    *buf = NULL;
     return -1;
   }
 
@@ -267,12 +524,17 @@ int ba_buffer_init_mem(ba_buffer_t **buf, const void *ptr, uint64_t size) {
   if (ctx->ptr == NULL) {
     free(ctx);
     free(*buf);
+    *buf = NULL;
     return -1;
   }
   memcpy(ctx->ptr, ptr, ctx->size);
+  ctx->cap = ctx->size;
   ctx->curr = 0;
 
   BA_BUF_INIT(*buf, mem);
+  BA_BUF_ASSI(*buf, mem, reserve)
+  BA_BUF_ASSI(*buf, mem, shrink)
+  BA_BUF_ASSI(*buf, mem, detach)
   (*buf)->arg = ctx;
 
   return 0;
@@ -294,12 +556,14 @@ int ba_buffer_init_file(ba_buffer_t **buf, const char *filename,
 #ifdef _WIN32
   if (fopen_s(&fp, filename, mode) != 0) {
     free(*buf);
+    *buf = NULL;
     return -1;
   }
 #else
   fp = fopen(filename, mode);
   if (fp == NULL) {
     free(*buf);
+    *buf = NULL;
     return -1;
   }
 #endif
@@ -310,6 +574,79 @@ int ba_buffer_init_file(ba_buffer_t **buf, const char *filename,
   return 0;
 }
 
+int ba_buffer_init_fp(ba_buffer_t **buf, FILE *fp) {
+  if (buf == NULL || fp == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *buf = calloc(1, sizeof(**buf));
+  if (*buf == NULL)
+    return -1;
+
+  BA_BUF_INIT(*buf, fp);
+  (*buf)->arg = fp;
+
+  return 0;
+}
+
+int ba_buffer_init_pipe(ba_buffer_t **buf, uint64_t cap) {
+  if (buf == NULL || cap == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *buf = calloc(1, sizeof(**buf));
+  if (*buf == NULL)
+    return -1;
+
+  struct ba_buffer_ctx_pipe *ctx = calloc(1, sizeof(*ctx));
+  if (ctx == NULL) {
+    free(*buf);
+    *buf = NULL;
+    return -1;
+  }
+
+  ctx->ring = malloc(ctx->cap = cap);
+  if (ctx->ring == NULL) {
+    free(ctx);
+    free(*buf);
+    *buf = NULL;
+    return -1;
+  }
+
+  if (ba_mutex_init(&ctx->lock) < 0) {
+    free(ctx->ring);
+    free(ctx);
+    free(*buf);
+    *buf = NULL;
+    return -1;
+  }
+
+  if (ba_cond_init(&ctx->cond) < 0) {
+    ba_mutex_destroy(&ctx->lock);
+    free(ctx->ring);
+    free(ctx);
+    free(*buf);
+    *buf = NULL;
+    return -1;
+  }
+
+  BA_BUF_INIT(*buf, pipe);
+  (*buf)->arg = ctx;
+
+  return 0;
+}
+
+void ba_buffer_close_pipe(ba_buffer_t *buf) {
+  struct ba_buffer_ctx_pipe *ctx = buf->arg;
+
+  ba_mutex_lock(&ctx->lock);
+  ctx->closed = 1;
+  ba_cond_broadcast(&ctx->cond);
+  ba_mutex_unlock(&ctx->lock);
+}
+
 void ba_buffer_free(ba_buffer_t **buf) {
   if (buf == NULL || *buf == NULL)
     return;
@@ -368,6 +705,24 @@ uint64_t ba_buffer_read(ba_buffer_t *buf, void *ptr, uint64_t size) {
   return buf->read(buf->arg, ptr, size);
 }
 
+uint64_t ba_buffer_pread(ba_buffer_t *buf, void *ptr, uint64_t size,
+                         uint64_t pos) {
+  if (buf == NULL || ptr == NULL) {
+    errno = EINVAL;
+    return ~0ULL;
+  }
+
+  if (size == 0)
+    return 0;
+
+  if (buf->pread == NULL) {
+    errno = EOPNOTSUPP;
+    return ~0ULL;
+  }
+
+  return buf->pread(buf->arg, ptr, size, pos);
+}
+
 int ba_buffer_write(ba_buffer_t *buf, const void *ptr, uint64_t size) {
   if (buf == NULL || ptr == NULL) {
     errno = EINVAL;
@@ -398,3 +753,47 @@ uint64_t ba_buffer_size(ba_buffer_t *buf) {
 
   return buf->size(buf->arg);
 }
+
+int ba_buffer_reserve(ba_buffer_t *buf, uint64_t size) {
+  if (buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (buf->reserve == NULL) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  return buf->reserve(buf->arg, size);
+}
+
+int ba_buffer_shrink_to_fit(ba_buffer_t *buf) {
+  if (buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (buf->shrink == NULL) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  return buf->shrink(buf->arg);
+}
+
+int ba_buffer_detach(ba_buffer_t *buf, void **ptr, uint64_t *size) {
+  if (buf == NULL || ptr == NULL || size == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (buf->detach == NULL) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  return buf->detach(buf->arg, ptr, size);
+}
+
+void ba_buffer_free_data(void *ptr) { free(ptr); }
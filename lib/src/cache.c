@@ -0,0 +1,378 @@
+#include "cache.h"
+#include <stdlib.h>
+
+static struct ba_cache_shard *cache_shard(struct ba_cache *cache,
+                                          uint64_t key) {
+  return &cache->shards[key % BA_CACHE_SHARDS];
+}
+
+int ba_cache_init(struct ba_cache *cache, uint32_t slots) {
+  uint32_t cap = (slots + BA_CACHE_SHARDS - 1) / BA_CACHE_SHARDS;
+  if (cap == 0)
+    cap = 1;
+
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS; i++) {
+    struct ba_cache_shard *shard = &cache->shards[i];
+
+    shard->items = calloc(cap, sizeof(*shard->items));
+    if (shard->items == NULL || ba_mutex_init(&shard->lock) < 0) {
+      free(shard->items);
+      while (i-- > 0) {
+        ba_mutex_destroy(&cache->shards[i].lock);
+        free(cache->shards[i].items);
+      }
+      return -1;
+    }
+
+    shard->cap = cap;
+    shard->tick = 0;
+  }
+
+  return 0;
+}
+
+void ba_cache_destroy(struct ba_cache *cache) {
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS; i++) {
+    struct ba_cache_shard *shard = &cache->shards[i];
+
+    for (uint32_t j = 0; j < shard->cap; j++)
+      free(shard->items[j]);
+
+    ba_mutex_destroy(&shard->lock);
+    free(shard->items);
+  }
+}
+
+struct ba_cache_item *ba_cache_item_alloc(uint64_t key, uint64_t size) {
+  struct ba_cache_item *item = malloc(sizeof(*item) + (size ? size : 1));
+  if (item == NULL)
+    return NULL;
+
+  item->key = key;
+  item->size = size;
+  item->tick = 0;
+  item->refs = 1;
+  item->live = 0;
+  item->prev = NULL;
+  item->next = NULL;
+
+  return item;
+}
+
+struct ba_cache_item *ba_cache_get(struct ba_cache *cache, uint64_t key) {
+  struct ba_cache_shard *shard = cache_shard(cache, key);
+  struct ba_cache_item *item = NULL;
+
+  ba_mutex_lock(&shard->lock);
+  for (uint32_t i = 0; i < shard->cap; i++) {
+    if (shard->items[i] != NULL && shard->items[i]->key == key) {
+      item = shard->items[i];
+      item->refs++;
+      item->tick = ++shard->tick;
+      break;
+    }
+  }
+  ba_mutex_unlock(&shard->lock);
+
+  return item;
+}
+
+struct ba_cache_item *ba_cache_put(struct ba_cache *cache,
+                                   struct ba_cache_item *item) {
+  struct ba_cache_shard *shard = cache_shard(cache, item->key);
+  struct ba_cache_item *victim = NULL;
+  uint32_t slot = 0;
+
+  ba_mutex_lock(&shard->lock);
+  for (uint32_t i = 0; i < shard->cap; i++) {
+    struct ba_cache_item *curr = shard->items[i];
+    if (curr != NULL && curr->key == item->key) {
+      curr->refs++;
+      curr->tick = ++shard->tick;
+      ba_mutex_unlock(&shard->lock);
+
+      free(item);
+      return curr;
+    }
+
+    if (curr == NULL || (shard->items[slot] != NULL &&
+                         curr->tick < shard->items[slot]->tick))
+      slot = i;
+  }
+
+  victim = shard->items[slot];
+  if (victim != NULL) {
+    victim->live = 0;
+    if (victim->refs != 0)
+      victim = NULL;
+  }
+
+  item->live = 1;
+  item->tick = ++shard->tick;
+  shard->items[slot] = item;
+  ba_mutex_unlock(&shard->lock);
+
+  free(victim);
+
+  return item;
+}
+
+void ba_cache_release(struct ba_cache *cache, struct ba_cache_item *item) {
+  if (item == NULL)
+    return;
+
+  struct ba_cache_shard *shard = cache_shard(cache, item->key);
+
+  ba_mutex_lock(&shard->lock);
+  int dead = --item->refs == 0 && !item->live;
+  ba_mutex_unlock(&shard->lock);
+
+  if (dead)
+    free(item);
+}
+
+static struct ba_lru_shard *lru_shard(struct ba_lru *lru, uint64_t key) {
+  return &lru->shards[key % BA_CACHE_SHARDS];
+}
+
+int ba_lru_init(struct ba_lru *lru, uint64_t size, uint64_t budget) {
+  lru->items = calloc(size ? size : 1, sizeof(*lru->items));
+  if (lru->items == NULL)
+    return -1;
+
+  if (ba_mutex_init(&lru->lock) < 0) {
+    free(lru->items);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS; i++) {
+    struct ba_lru_shard *shard = &lru->shards[i];
+
+    if (ba_mutex_init(&shard->lock) < 0) {
+      while (i-- > 0)
+        ba_mutex_destroy(&lru->shards[i].lock);
+      ba_mutex_destroy(&lru->lock);
+      free(lru->items);
+      return -1;
+    }
+
+    shard->head = NULL;
+    shard->tail = NULL;
+    shard->hits = 0;
+    shard->misses = 0;
+  }
+
+  lru->size = size;
+  lru->bytes = 0;
+  lru->budget = budget;
+
+  return 0;
+}
+
+void ba_lru_destroy(struct ba_lru *lru) {
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS; i++) {
+    struct ba_lru_shard *shard = &lru->shards[i];
+
+    struct ba_cache_item *item = shard->head;
+    while (item != NULL) {
+      struct ba_cache_item *next = item->next;
+      free(item);
+      item = next;
+    }
+
+    ba_mutex_destroy(&shard->lock);
+  }
+
+  ba_mutex_destroy(&lru->lock);
+  free(lru->items);
+}
+
+static void lru_unlink(struct ba_lru_shard *shard,
+                       struct ba_cache_item *item) {
+  if (item->prev != NULL)
+    item->prev->next = item->next;
+  else
+    shard->head = item->next;
+
+  if (item->next != NULL)
+    item->next->prev = item->prev;
+  else
+    shard->tail = item->prev;
+
+  item->prev = NULL;
+  item->next = NULL;
+}
+
+static void lru_push(struct ba_lru_shard *shard, struct ba_cache_item *item) {
+  item->prev = NULL;
+  item->next = shard->head;
+  if (shard->head != NULL)
+    shard->head->prev = item;
+  else
+    shard->tail = item;
+  shard->head = item;
+}
+
+static int lru_full(struct ba_lru *lru) {
+  ba_mutex_lock(&lru->lock);
+  int full = lru->bytes > lru->budget;
+  ba_mutex_unlock(&lru->lock);
+
+  return full;
+}
+
+/* The byte total is shared by all shards. Its lock is taken with a shard lock
+ * held, never the other way round. */
+static int lru_uncharge(struct ba_lru *lru, uint64_t size) {
+  ba_mutex_lock(&lru->lock);
+  int full = lru->bytes > lru->budget;
+  if (full)
+    lru->bytes -= size;
+  ba_mutex_unlock(&lru->lock);
+
+  return full;
+}
+
+static struct ba_cache_item *lru_evict(struct ba_lru *lru,
+                                       struct ba_lru_shard *shard,
+                                       const struct ba_cache_item *keep,
+                                       struct ba_cache_item *dead) {
+  while (shard->tail != NULL && shard->tail != keep &&
+         lru_uncharge(lru, shard->tail->size)) {
+    struct ba_cache_item *victim = shard->tail;
+    lru_unlink(shard, victim);
+    lru->items[victim->key] = NULL;
+    victim->live = 0;
+
+    if (victim->refs == 0) {
+      victim->next = dead;
+      dead = victim;
+    }
+  }
+
+  return dead;
+}
+
+static void lru_free(struct ba_cache_item *dead) {
+  while (dead != NULL) {
+    struct ba_cache_item *next = dead->next;
+    free(dead);
+    dead = next;
+  }
+}
+
+/* Evicts from the shard of key first, then from its neighbours, until the
+ * cached bytes fit the budget again. */
+static void lru_trim(struct ba_lru *lru, uint64_t key,
+                     const struct ba_cache_item *keep) {
+  struct ba_cache_item *dead = NULL;
+
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS && lru_full(lru); i++) {
+    struct ba_lru_shard *shard = lru_shard(lru, key + i);
+
+    ba_mutex_lock(&shard->lock);
+    dead = lru_evict(lru, shard, keep, dead);
+    ba_mutex_unlock(&shard->lock);
+  }
+
+  lru_free(dead);
+}
+
+void ba_lru_set_budget(struct ba_lru *lru, uint64_t budget) {
+  ba_mutex_lock(&lru->lock);
+  lru->budget = budget;
+  ba_mutex_unlock(&lru->lock);
+
+  lru_trim(lru, 0, NULL);
+}
+
+void ba_lru_stats(struct ba_lru *lru, uint64_t *hits, uint64_t *misses,
+                  uint64_t *bytes) {
+  for (uint32_t i = 0; i < BA_CACHE_SHARDS; i++) {
+    struct ba_lru_shard *shard = &lru->shards[i];
+
+    ba_mutex_lock(&shard->lock);
+    *hits += shard->hits;
+    *misses += shard->misses;
+    ba_mutex_unlock(&shard->lock);
+  }
+
+  ba_mutex_lock(&lru->lock);
+  *bytes += lru->bytes;
+  ba_mutex_unlock(&lru->lock);
+}
+
+struct ba_cache_item *ba_lru_get(struct ba_lru *lru, uint64_t key) {
+  if (key >= lru->size)
+    return NULL;
+
+  struct ba_lru_shard *shard = lru_shard(lru, key);
+
+  ba_mutex_lock(&shard->lock);
+  struct ba_cache_item *item = lru->items[key];
+  if (item != NULL) {
+    item->refs++;
+    lru_unlink(shard, item);
+    lru_push(shard, item);
+    shard->hits++;
+  } else {
+    shard->misses++;
+  }
+  ba_mutex_unlock(&shard->lock);
+
+  return item;
+}
+
+struct ba_cache_item *ba_lru_put(struct ba_lru *lru,
+                                 struct ba_cache_item *item) {
+  if (item->key >= lru->size)
+    return item;
+
+  struct ba_lru_shard *shard = lru_shard(lru, item->key);
+
+  ba_mutex_lock(&shard->lock);
+  struct ba_cache_item *curr = lru->items[item->key];
+  if (curr != NULL) {
+    curr->refs++;
+    lru_unlink(shard, curr);
+    lru_push(shard, curr);
+    ba_mutex_unlock(&shard->lock);
+
+    free(item);
+    return curr;
+  }
+
+  ba_mutex_lock(&lru->lock);
+  int fits = item->size <= lru->budget;
+  if (fits)
+    lru->bytes += item->size;
+  ba_mutex_unlock(&lru->lock);
+
+  if (!fits) {
+    ba_mutex_unlock(&shard->lock);
+    return item;
+  }
+
+  item->live = 1;
+  lru->items[item->key] = item;
+  lru_push(shard, item);
+  ba_mutex_unlock(&shard->lock);
+
+  lru_trim(lru, item->key, item);
+
+  return item;
+}
+
+void ba_lru_release(struct ba_lru *lru, struct ba_cache_item *item) {
+  if (item == NULL)
+    return;
+
+  struct ba_lru_shard *shard = lru_shard(lru, item->key);
+
+  ba_mutex_lock(&shard->lock);
+  int dead = --item->refs == 0 && !item->live;
+  ba_mutex_unlock(&shard->lock);
+
+  if (dead)
+    free(item);
+}
@@ -0,0 +1,69 @@
+#ifndef BA_CACHE_H
+#define BA_CACHE_H
+
+#include "thread.h"
+#include <stdint.h>
+
+#define BA_CACHE_SHARDS 4
+
+struct ba_cache_item {
+  uint64_t key;
+  uint64_t size;
+  uint64_t tick;
+  uint32_t refs;
+  int live;
+  struct ba_cache_item *prev;
+  struct ba_cache_item *next;
+  uint8_t data[];
+};
+
+struct ba_cache_shard {
+  ba_mutex_t lock;
+  struct ba_cache_item **items;
+  uint32_t cap;
+  uint64_t tick;
+};
+
+struct ba_cache {
+  struct ba_cache_shard shards[BA_CACHE_SHARDS];
+};
+
+struct ba_lru_shard {
+  ba_mutex_t lock;
+  struct ba_cache_item *head;
+  struct ba_cache_item *tail;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+struct ba_lru {
+  struct ba_cache_item **items;
+  uint64_t size;
+  ba_mutex_t lock;
+  uint64_t bytes;
+  uint64_t budget;
+  struct ba_lru_shard shards[BA_CACHE_SHARDS];
+};
+
+int ba_cache_init(struct ba_cache *cache, uint32_t slots);
+void ba_cache_destroy(struct ba_cache *cache);
+
+struct ba_cache_item *ba_cache_item_alloc(uint64_t key, uint64_t size);
+
+struct ba_cache_item *ba_cache_get(struct ba_cache *cache, uint64_t key);
+struct ba_cache_item *ba_cache_put(struct ba_cache *cache,
+                                   struct ba_cache_item *item);
+void ba_cache_release(struct ba_cache *cache, struct ba_cache_item *item);
+
+int ba_lru_init(struct ba_lru *lru, uint64_t size, uint64_t budget);
+void ba_lru_destroy(struct ba_lru *lru);
+void ba_lru_set_budget(struct ba_lru *lru, uint64_t budget);
+void ba_lru_stats(struct ba_lru *lru, uint64_t *hits, uint64_t *misses,
+                  uint64_t *bytes);
+
+struct ba_cache_item *ba_lru_get(struct ba_lru *lru, uint64_t key);
+struct ba_cache_item *ba_lru_put(struct ba_lru *lru,
+                                 struct ba_cache_item *item);
+void ba_lru_release(struct ba_lru *lru, struct ba_cache_item *item);
+
+#endif
@@ -0,0 +1,129 @@
+#include "codec.h"
+#include "thread.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BA_POOL_MAX 64
+
+struct ba_pooled_stream {
+  z_stream strm;
+  int level;
+  struct ba_pooled_stream *next;
+};
+
+struct ba_stream_pool {
+  ba_mutex_t lock;
+  struct ba_pooled_stream *head;
+  uint32_t size;
+};
+
+static struct ba_stream_pool inflaters = {BA_MUTEX_INIT, NULL, 0};
+static struct ba_stream_pool deflaters = {BA_MUTEX_INIT, NULL, 0};
+
+static void stream_clear(z_stream *strm) {
+  strm->next_in = Z_NULL;
+  strm->avail_in = 0;
+  strm->next_out = Z_NULL;
+  strm->avail_out = 0;
+}
+
+static struct ba_pooled_stream *pool_take(struct ba_stream_pool *pool,
+                                          int level) {
+  ba_mutex_lock(&pool->lock);
+
+  struct ba_pooled_stream **it = &pool->head;
+  while (*it != NULL && (*it)->level != level)
+    it = &(*it)->next;
+
+  struct ba_pooled_stream *node = *it;
+  if (node != NULL) {
+    *it = node->next;
+    pool->size--;
+  }
+
+  ba_mutex_unlock(&pool->lock);
+
+  return node;
+}
+
+static int pool_give(struct ba_stream_pool *pool,
+                     struct ba_pooled_stream *node) {
+  ba_mutex_lock(&pool->lock);
+
+  if (pool->size >= BA_POOL_MAX) {
+    ba_mutex_unlock(&pool->lock);
+    return -1;
+  }
+
+  node->next = pool->head;
+  pool->head = node;
+  pool->size++;
+
+  ba_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+z_stream *ba_inflater_acquire(void) {
+  struct ba_pooled_stream *node = pool_take(&inflaters, 0);
+  if (node != NULL)
+    return &node->strm;
+
+  node = calloc(1, sizeof(*node));
+  if (node == NULL)
+    return NULL;
+
+  if (inflateInit(&node->strm) != Z_OK) {
+    free(node);
+    errno = EIO;
+    return NULL;
+  }
+
+  return &node->strm;
+}
+
+void ba_inflater_release(z_stream *strm) {
+  if (strm == NULL)
+    return;
+
+  struct ba_pooled_stream *node = (struct ba_pooled_stream *)strm;
+
+  stream_clear(strm);
+  if (inflateReset(strm) != Z_OK || pool_give(&inflaters, node) < 0) {
+    inflateEnd(strm);
+    free(node);
+  }
+}
+
+z_stream *ba_deflater_acquire(int level) {
+  struct ba_pooled_stream *node = pool_take(&deflaters, level);
+  if (node != NULL)
+    return &node->strm;
+
+  node = calloc(1, sizeof(*node));
+  if (node == NULL)
+    return NULL;
+
+  if (deflateInit(&node->strm, level) != Z_OK) {
+    free(node);
+    errno = EIO;
+    return NULL;
+  }
+  node->level = level;
+
+  return &node->strm;
+}
+
+void ba_deflater_release(z_stream *strm) {
+  if (strm == NULL)
+    return;
+
+  struct ba_pooled_stream *node = (struct ba_pooled_stream *)strm;
+
+  stream_clear(strm);
+  if (deflateReset(strm) != Z_OK || pool_give(&deflaters, node) < 0) {
+    deflateEnd(strm);
+    free(node);
+  }
+}
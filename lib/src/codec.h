@@ -0,0 +1,12 @@
+#ifndef BA_CODEC_H
+#define BA_CODEC_H
+
+#include <zlib.h>
+
+z_stream *ba_inflater_acquire(void);
+void ba_inflater_release(z_stream *strm);
+
+z_stream *ba_deflater_acquire(int level);
+void ba_deflater_release(z_stream *strm);
+
+#endif
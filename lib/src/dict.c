@@ -0,0 +1,87 @@
+#include "dict.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BA_DICT_DMER 8
+#define BA_DICT_SEGMENT 64
+#define BA_DICT_HASH_BITS 18
+
+static uint32_t dmer_hash(const uint8_t *ptr) {
+  uint64_t val;
+  memcpy(&val, ptr, sizeof(val));
+  return (uint32_t)((val * 0x9e3779b97f4a7c15ULL) >> (64 - BA_DICT_HASH_BITS));
+}
+
+static uint64_t segment_score(const uint32_t *freq, const uint8_t *ptr,
+                              uint64_t len) {
+  uint64_t score = 0;
+  for (uint64_t i = 0; i + BA_DICT_DMER <= len; i++) {
+    uint32_t f = freq[dmer_hash(&ptr[i])];
+    if (f > 1)
+      score += f;
+  }
+  return score;
+}
+
+int ba_dict_train(const uint8_t *samples, const uint64_t *ends, uint32_t count,
+                  uint8_t *dict, uint32_t cap, uint32_t *len) {
+  *len = 0;
+
+  if (count == 0 || ends[count - 1] < BA_DICT_DMER)
+    return 0;
+
+  uint32_t *freq = calloc(1u << BA_DICT_HASH_BITS, sizeof(*freq));
+  if (freq == NULL)
+    return -1;
+
+  uint64_t segments = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t start = i ? ends[i - 1] : 0;
+    for (uint64_t p = start; p + BA_DICT_DMER <= ends[i]; p++)
+      freq[dmer_hash(&samples[p])]++;
+    segments += (ends[i] - start + BA_DICT_SEGMENT - 1) / BA_DICT_SEGMENT;
+  }
+
+  uint64_t picks = cap / BA_DICT_SEGMENT ? cap / BA_DICT_SEGMENT : 1;
+  uint64_t epoch = segments / picks ? segments / picks : 1;
+
+  uint32_t sample = 0;
+  uint64_t pos = 0;
+  while (sample < count && *len + BA_DICT_DMER <= cap) {
+    uint64_t best_score = 0;
+    uint64_t best_off = 0;
+    uint64_t best_len = 0;
+
+    for (uint64_t k = 0; k < epoch && sample < count; k++) {
+      uint64_t n = ends[sample] - pos;
+      if (n > BA_DICT_SEGMENT)
+        n = BA_DICT_SEGMENT;
+
+      uint64_t score = segment_score(freq, &samples[pos], n);
+      if (score > best_score) {
+        best_score = score;
+        best_off = pos;
+        best_len = n;
+      }
+
+      pos += n;
+      if (pos == ends[sample])
+        sample++;
+    }
+
+    if (best_score == 0)
+      continue;
+
+    for (uint64_t i = 0; i + BA_DICT_DMER <= best_len; i++)
+      freq[dmer_hash(&samples[best_off + i])] = 0;
+
+    if (best_len > cap - *len)
+      best_len = cap - *len;
+    memcpy(&dict[*len], &samples[best_off], best_len);
+    *len += best_len;
+  }
+
+  free(freq);
+
+  return 0;
+}
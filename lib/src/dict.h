@@ -0,0 +1,13 @@
+#ifndef BA_DICT_H
+#define BA_DICT_H
+
+#include <stdint.h>
+
+#define BA_DICT_MAX 0x8000
+#define BA_DICT_SAMPLE_ENTRY 0x4000
+#define BA_DICT_SAMPLE_RATIO 64
+
+int ba_dict_train(const uint8_t *samples, const uint64_t *ends, uint32_t count,
+                  uint8_t *dict, uint32_t cap, uint32_t *len);
+
+#endif
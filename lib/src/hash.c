@@ -0,0 +1,31 @@
+#include "hash.h"
+#include <ba/reader.h>
+
+uint32_t ba_hash(const void *data, uint64_t len) {
+  const uint8_t *ptr = data;
+  uint32_t hash = 2166136261u;
+
+  for (uint64_t i = 0; i < len; i++) {
+    hash ^= ptr[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+uint32_t ba_hash_capacity(uint32_t count) {
+  uint32_t cap = 1;
+  while (cap < count * 2ULL && cap < 0x80000000u)
+    cap <<= 1;
+  return cap;
+}
+
+void ba_hash_insert(struct ba_hash_slot *slots, uint32_t cap, uint32_t hash,
+                    uint32_t id) {
+  uint32_t i = hash & (cap - 1);
+  while (slots[i].id != BA_ENTRY_INVALID)
+    i = (i + 1) & (cap - 1);
+
+  slots[i].hash = hash;
+  slots[i].id = id;
+}
@@ -0,0 +1,14 @@
+#ifndef BA_HASH_H
+#define BA_HASH_H
+
+#include "headers.h"
+#include <stdint.h>
+
+uint32_t ba_hash(const void *data, uint64_t len);
+
+uint32_t ba_hash_capacity(uint32_t count);
+
+void ba_hash_insert(struct ba_hash_slot *slots, uint32_t cap, uint32_t hash,
+                    uint32_t id);
+
+#endif
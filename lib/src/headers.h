@@ -9,12 +9,92 @@ struct ba_archive_header {
   uint64_t tbsz;
 };
 
+struct ba_archive_extension {
+  uint32_t flag;
+  uint32_t sccn;
+};
+
+#define BA_ARCHIVE_TRAILING 0x1
+
+/* A trailing stub has ensz 0 and tbsz set to the end of the committed
+ * footer, or 0 when the footer ends the file. */
+
+struct ba_archive_footer {
+  uint64_t ioff;
+  uint32_t sign;
+  uint32_t rsvd;
+};
+
+struct ba_section_header {
+  uint32_t type;
+  uint32_t rsvd;
+  uint64_t soff;
+  uint64_t ssiz;
+};
+
+#define BA_SECTION_HASH 1
+#define BA_SECTION_DICT 2
+#define BA_SECTION_SOLID 3
+#define BA_SECTION_UPDATE 4
+#define BA_SECTION_SOURCE 5
+#define BA_SECTION_PRELOAD 6
+
+struct ba_entry_header_v1 {
+  uint64_t tidx;
+  uint64_t tlen;
+  uint64_t boff;
+  uint64_t bcsz;
+  uint64_t bosz;
+};
+
 struct ba_entry_header {
   uint64_t tidx;
   uint64_t tlen;
   uint64_t boff;
   uint64_t bcsz;
   uint64_t bosz;
+  uint16_t flag;
+  uint16_t codc;
+  uint32_t bksz;
+};
+
+#define BA_ENTRY_BLOCKS 0x1
+#define BA_ENTRY_DICT 0x2
+#define BA_ENTRY_PRELOAD 0x4
+
+#define BA_ENTRY_DEFLATE 0
+#define BA_ENTRY_STORE 1
+#define BA_ENTRY_SOLID 2
+
+struct ba_solid_block {
+  uint64_t boff;
+  uint64_t bcsz;
+  uint64_t bosz;
+  uint16_t flag;
+  uint16_t codc;
+  uint32_t rsvd;
+};
+
+struct ba_update_info {
+  uint64_t dead;
+  uint64_t gnum;
+};
+
+struct ba_preload_info {
+  uint64_t boff;
+  uint64_t bsiz;
+};
+
+struct ba_source_info {
+  uint64_t size;
+  int64_t mtim;
+  uint32_t hash;
+  uint32_t rsvd;
+};
+
+struct ba_hash_slot {
+  uint32_t hash;
+  uint32_t id;
 };
 
 #endif
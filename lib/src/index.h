@@ -0,0 +1,24 @@
+#ifndef BA_INDEX_H
+#define BA_INDEX_H
+
+#include "headers.h"
+#include <ba/reader.h>
+#include <stdint.h>
+
+const struct ba_entry_header *ba_index_entries(const ba_reader_t *rd);
+
+const uint8_t *ba_index_dict(const ba_reader_t *rd, uint32_t *len);
+
+const struct ba_solid_block *ba_index_solid(const ba_reader_t *rd,
+                                            uint32_t *count);
+
+const struct ba_update_info *ba_index_update(const ba_reader_t *rd);
+
+const struct ba_source_info *ba_index_sources(const ba_reader_t *rd);
+
+uint64_t ba_index_size(const ba_reader_t *rd);
+
+int ba_index_pread(const ba_reader_t *rd, void *ptr, uint64_t size,
+                   uint64_t off);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef BA_PIPE_H
+#define BA_PIPE_H
+
+#include <ba/buffer.h>
+
+int ba_buffer_init_pipe(ba_buffer_t **buf, uint64_t cap);
+void ba_buffer_close_pipe(ba_buffer_t *buf);
+
+#endif
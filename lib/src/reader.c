@@ -1,17 +1,162 @@
+#include "cache.h"
+#include "codec.h"
+#include "hash.h"
 #include "headers.h"
+#include "index.h"
 #include "signature.h"
+#include "thread.h"
 #include <ba/reader.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 struct ba_reader {
   void *data;
+  void *map;
+  uint64_t map_size;
+  ba_buffer_t *buf;
+  int own_buf;
+  const uint8_t *base;
+  uint64_t size;
   const struct ba_archive_header *ahdr;
+  const struct ba_archive_extension *ext;
+  const struct ba_section_header *sect;
   const struct ba_entry_header *ehdr;
+  struct ba_entry_header *ehdr_data;
   const char *tble;
+  const struct ba_hash_slot *hash;
+  void *hash_data;
+  uint32_t hcap;
+  const uint8_t *dict;
+  void *dict_data;
+  uint32_t dict_len;
+  const struct ba_solid_block *solid;
+  void *solid_data;
+  uint32_t solid_count;
+  struct ba_cache *blocks;
+  struct ba_update_info update;
+  const struct ba_source_info *sources;
+  void *sources_data;
+  struct ba_preload_info *preload;
+  uint32_t preload_count;
+  struct ba_warm *warm;
+  struct ba_lru *entries;
+  struct ba_trace *trace;
+  uint32_t threads;
+  ba_mutex_t lock;
+  struct ba_async *async;
+};
+
+struct ba_read_slot {
+  uint64_t boff;
+  uint64_t skip;
+  uint32_t idx;
+};
+
+struct ba_read_pool {
+  ba_reader_t *rd;
+  const ba_id_t *ids;
+  void *const *ptrs;
+  int *errs;
+  struct ba_read_slot *slots;
+  uint32_t count;
+  uint32_t left;
+  int err;
+};
+
+struct ba_read_request {
+  ba_reader_t *rd;
+  ba_id_t id;
+  void *ptr;
+  ba_read_callback cb;
+  void *arg;
+  struct ba_read_request *next;
+  struct ba_read_pool *pool;
+  uint32_t idx;
+  uint32_t slot;
+  int32_t priority;
+  uint64_t deadline;
+  uint64_t seq;
+  uint64_t lo;
+  uint64_t hi;
+  int state;
+  int keep;
+  int err;
+};
+
+#define BA_READ_QUEUED 0
+#define BA_READ_RUNNING 1
+#define BA_READ_DONE 2
+
+#define BA_READ_GAP 0x1000
+#define BA_READ_SPAN 0x100000
+
+struct ba_async {
+  ba_reader_t *rd;
+  ba_mutex_t lock;
+  ba_cond_t cond;
+  ba_cond_t done;
+  ba_thread_t *workers;
+  uint32_t count;
+  struct ba_read_request **heap;
+  struct ba_read_request **spans;
+  uint32_t size;
+  uint32_t cap;
+  uint64_t seq;
+  uint64_t completed;
+  uint64_t canceled;
+  uint64_t late;
+  uint64_t merged;
+  int stop;
+};
+
+/* Decoded preload entries are held for the life of the reader, so only this
+ * many bytes of them are decoded ahead. */
+#define BA_WARM_BUDGET 0x4000000
+
+struct ba_warm {
+  ba_thread_t thread;
+  ba_mutex_t lock;
+  void **data;
+  int stop;
+};
+
+struct ba_trace {
+  ba_mutex_t lock;
+  uint8_t *seen;
+  ba_id_t *ids;
+  uint32_t size;
+  int on;
+};
+
+#define BA_STREAM_CHUNK 0x10000
+#define BA_READER_BLOCKS 8
+
+struct ba_entry_stream {
+  const ba_reader_t *rd;
+  z_stream *strm;
+  uint64_t next;
+  uint64_t left;
+  uint64_t skip;
+  uint64_t blocks;
+  uint8_t *chunk;
+  struct ba_cache_item *block;
+  const uint8_t *src;
+  uint64_t src_off;
+  int done;
 };
 
 int ba_reader_alloc(ba_reader_t **rd) {
@@ -24,155 +169,2241 @@ int ba_reader_alloc(ba_reader_t **rd) {
   if (*rd == NULL)
     return -1;
 
+  if (ba_mutex_init(&(*rd)->lock) < 0) {
+    free(*rd);
+    *rd = NULL;
+    return -1;
+  }
+
   return 0;
 }
 
-void ba_reader_free(ba_reader_t **rd) {
-  if (rd == NULL) {
+static int map_file(const char *filename, void **map, uint64_t *size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
     errno = EINVAL;
-    return;
+    return -1;
   }
 
-  free((*rd)->data);
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL) {
+    errno = EIO;
+    return -1;
+  }
 
-  free(*rd);
+  *map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (*map == NULL) {
+    errno = EIO;
+    return -1;
+  }
 
-  *rd = NULL;
-}
+  *size = file_size.QuadPart;
 
-int ba_reader_open(ba_reader_t *rd, ba_buffer_t *buf) {
-  if (rd == NULL || buf == NULL) {
+  return 0;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (st.st_size == 0) {
+    close(fd);
     errno = EINVAL;
     return -1;
   }
 
-  uint64_t size = ba_buffer_size(buf);
-  if (size == 0)
+  *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (*map == MAP_FAILED) {
+    *map = NULL;
     return -1;
+  }
 
-  if (ba_buffer_seek(buf, 0, SEEK_SET) < 0)
+  *size = st.st_size;
+
+  return 0;
+#endif
+}
+
+static void unmap_file(void *map, uint64_t size) {
+  if (map == NULL)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(map);
+#else
+  munmap(map, size);
+#endif
+}
+
+static int index_size(const void *head, uint64_t head_size, uint64_t avail,
+                      uint64_t *size) {
+  const struct ba_archive_header *ahdr = head;
+
+  if (head_size < sizeof(*ahdr)) {
+    errno = EINVAL;
     return -1;
+  }
 
-  rd->data = malloc(size);
-  if (rd->data == NULL)
+  uint64_t prefix = sizeof(*ahdr);
+  if (ahdr->sign == BA_SIGNATURE_V2) {
+    const struct ba_archive_extension *ext =
+        (const struct ba_archive_extension *)&ahdr[1];
+    if (head_size < sizeof(*ahdr) + sizeof(*ext)) {
+      errno = EINVAL;
+      return -1;
+    }
+    prefix += sizeof(*ext) + ext->sccn * sizeof(struct ba_section_header);
+    prefix += ahdr->ensz * sizeof(struct ba_entry_header);
+  } else if (ahdr->sign == BA_SIGNATURE) {
+    prefix += ahdr->ensz * sizeof(struct ba_entry_header_v1);
+  } else {
+    errno = EINVAL;
     return -1;
+  }
 
-  while (ba_buffer_read(buf, rd->data, size) < size)
+  if (avail < prefix || avail - prefix < ahdr->tbsz) {
+    errno = EINVAL;
     return -1;
+  }
+
+  *size = prefix + ahdr->tbsz;
+
+  return 0;
+}
+
+static int head_trailing(const void *head, uint64_t head_size) {
+  const struct ba_archive_header *ahdr = head;
+  const struct ba_archive_extension *ext =
+      (const struct ba_archive_extension *)&ahdr[1];
+
+  return head_size >= sizeof(*ahdr) + sizeof(*ext) &&
+         ahdr->sign == BA_SIGNATURE_V2 && (ext->flag & BA_ARCHIVE_TRAILING);
+}
 
-  rd->ahdr = rd->data;
-  rd->ehdr = (const struct ba_entry_header *)&rd->ahdr[1];
-  rd->tble = (const char *)&rd->ehdr[rd->ahdr->ensz];
+static uint64_t trailing_end(const void *head, uint64_t size) {
+  const struct ba_archive_header *ahdr = head;
 
-  if (rd->ahdr->sign != BA_SIGNATURE) {
+  return ahdr->tbsz != 0 && ahdr->tbsz <= size ? ahdr->tbsz : size;
+}
+
+static int footer_offset(const struct ba_archive_footer *foot, uint64_t size,
+                         uint64_t *off) {
+  if (size < sizeof(*foot) || foot->sign != BA_SIGNATURE_V2 ||
+      foot->ioff > size - sizeof(*foot) || (foot->ioff & 7) != 0) {
     errno = EINVAL;
     return -1;
   }
 
+  *off = foot->ioff;
+
   return 0;
 }
 
-int ba_reader_open_file(ba_reader_t *rd, const char *filename) {
-  if (rd == NULL || filename == NULL) {
+static int reader_locate(const uint8_t *base, uint64_t size, uint64_t *off,
+                         uint64_t *avail, uint64_t *end) {
+  *off = 0;
+  *avail = size;
+  *end = size;
+
+  if (!head_trailing(base, size))
+    return 0;
+
+  *end = trailing_end(base, size);
+
+  struct ba_archive_footer foot;
+  if (*end < sizeof(foot)) {
     errno = EINVAL;
     return -1;
   }
+  memcpy(&foot, &base[*end - sizeof(foot)], sizeof(foot));
 
-  ba_buffer_t *buf;
-  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+  if (footer_offset(&foot, *end, off) < 0)
     return -1;
 
-  if (ba_reader_open(rd, buf) < 0) {
-    ba_buffer_free(&buf);
+  *avail = *end - sizeof(foot) - *off;
+
+  return 0;
+}
+
+static int reader_attach(ba_reader_t *rd, const void *index, uint64_t size) {
+  uint64_t isz;
+  if (index_size(index, size, size, &isz) < 0)
     return -1;
+
+  rd->ahdr = index;
+  if (rd->ahdr->sign == BA_SIGNATURE_V2) {
+    rd->ext = (const struct ba_archive_extension *)&rd->ahdr[1];
+    rd->sect = (const struct ba_section_header *)&rd->ext[1];
+    rd->ehdr = (const struct ba_entry_header *)&rd->sect[rd->ext->sccn];
+    rd->tble = (const char *)&rd->ehdr[rd->ahdr->ensz];
+  } else {
+    const struct ba_entry_header_v1 *ehdr =
+        (const struct ba_entry_header_v1 *)&rd->ahdr[1];
+
+    rd->ehdr_data = calloc(rd->ahdr->ensz ? rd->ahdr->ensz : 1,
+                           sizeof(*rd->ehdr_data));
+    if (rd->ehdr_data == NULL)
+      return -1;
+
+    for (uint32_t i = 0; i < rd->ahdr->ensz; i++) {
+      rd->ehdr_data[i].tidx = ehdr[i].tidx;
+      rd->ehdr_data[i].tlen = ehdr[i].tlen;
+      rd->ehdr_data[i].boff = ehdr[i].boff;
+      rd->ehdr_data[i].bcsz = ehdr[i].bcsz;
+      rd->ehdr_data[i].bosz = ehdr[i].bosz;
+    }
+
+    rd->ext = NULL;
+    rd->sect = NULL;
+    rd->ehdr = rd->ehdr_data;
+    rd->tble = (const char *)&ehdr[rd->ahdr->ensz];
   }
 
   return 0;
 }
 
-uint32_t ba_reader_size(const ba_reader_t *rd) {
-  if (rd == NULL) {
+static int reader_fetch(const ba_reader_t *rd, uint64_t off, uint64_t size,
+                        const void **ptr, void **data) {
+  if (off > rd->size || rd->size - off < size) {
     errno = EINVAL;
+    return -1;
+  }
+
+  if (rd->base != NULL) {
+    *ptr = &rd->base[off];
+    *data = NULL;
     return 0;
   }
 
-  return rd->ahdr->ensz;
+  *data = malloc(size ? size : 1);
+  if (*data == NULL)
+    return -1;
+
+  if (ba_buffer_pread(rd->buf, *data, size, off) != size) {
+    free(*data);
+    *data = NULL;
+    errno = EIO;
+    return -1;
+  }
+
+  *ptr = *data;
+
+  return 0;
 }
 
-ba_id_t ba_reader_find_entry(const ba_reader_t *rd, const char *entry,
-                             uint64_t entry_len) {
-  if (rd == NULL || entry == NULL) {
-    errno = EINVAL;
-    return BA_ENTRY_INVALID;
+static const struct ba_section_header *reader_section(const ba_reader_t *rd,
+                                                      uint32_t type) {
+  if (rd->ext == NULL)
+    return NULL;
+
+  for (uint32_t i = 0; i < rd->ext->sccn; i++)
+    if (rd->sect[i].type == type)
+      return &rd->sect[i];
+
+  return NULL;
+}
+
+static int reader_load_hash(ba_reader_t *rd) {
+  const struct ba_section_header *sect = reader_section(rd, BA_SECTION_HASH);
+  if (sect != NULL && sect->ssiz % sizeof(struct ba_hash_slot) == 0) {
+    uint64_t cap = sect->ssiz / sizeof(struct ba_hash_slot);
+    if (cap > rd->ahdr->ensz && cap <= 0x80000000u && (cap & (cap - 1)) == 0) {
+      const void *ptr;
+      if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &rd->hash_data) < 0)
+        return -1;
+
+      if (((uintptr_t)ptr & (sizeof(struct ba_hash_slot) - 1)) == 0) {
+        rd->hash = ptr;
+        rd->hcap = cap;
+
+        return 0;
+      }
+
+      free(rd->hash_data);
+      rd->hash_data = NULL;
+    }
   }
 
-  if (entry_len == 0)
-    entry_len = strlen(entry);
+  uint32_t cap = ba_hash_capacity(rd->ahdr->ensz);
+  struct ba_hash_slot *slots = malloc(cap * sizeof(*slots));
+  if (slots == NULL)
+    return -1;
+  memset(slots, 0xff, cap * sizeof(*slots));
 
-  ba_id_t id;
-  for (id = 0; id < rd->ahdr->ensz; id++)
-    if (entry_len == rd->ehdr[id].tlen &&
-        strncmp(entry, &rd->tble[rd->ehdr[id].tidx], rd->ehdr[id].tlen) == 0)
-      break;
-  if (id >= rd->ahdr->ensz) {
-    errno = ENOENT;
-    return BA_ENTRY_INVALID;
+  for (ba_id_t id = 0; id < rd->ahdr->ensz; id++) {
+    if (rd->ehdr[id].tidx > rd->ahdr->tbsz ||
+        rd->ahdr->tbsz - rd->ehdr[id].tidx < rd->ehdr[id].tlen)
+      continue;
+    ba_hash_insert(slots, cap,
+                   ba_hash(&rd->tble[rd->ehdr[id].tidx], rd->ehdr[id].tlen),
+                   id);
   }
 
-  return id;
+  rd->hash = slots;
+  rd->hash_data = slots;
+  rd->hcap = cap;
+
+  return 0;
 }
 
-int ba_reader_entry_name(const ba_reader_t *rd, ba_id_t id, const char **str,
-                         uint64_t *len) {
-  if (rd == NULL || id >= rd->ahdr->ensz || str == NULL || len == NULL) {
+static int reader_load_dict(ba_reader_t *rd) {
+  const struct ba_section_header *sect = reader_section(rd, BA_SECTION_DICT);
+  if (sect == NULL)
+    return 0;
+
+  if (sect->ssiz == 0 || sect->ssiz > UINT_MAX) {
     errno = EINVAL;
     return -1;
   }
 
-  *str = &rd->tble[rd->ehdr[id].tidx];
-  *len = rd->ehdr[id].tlen;
+  const void *ptr;
+  if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &rd->dict_data) < 0)
+    return -1;
+
+  rd->dict = ptr;
+  rd->dict_len = sect->ssiz;
 
   return 0;
 }
 
-uint64_t ba_reader_entry_size(const ba_reader_t *rd, ba_id_t id) {
-  if (rd == NULL || id >= rd->ahdr->ensz) {
+static int reader_load_solid(ba_reader_t *rd) {
+  const struct ba_section_header *sect = reader_section(rd, BA_SECTION_SOLID);
+  if (sect == NULL)
+    return 0;
+
+  if (sect->ssiz % sizeof(struct ba_solid_block) != 0 ||
+      sect->ssiz / sizeof(struct ba_solid_block) > UINT32_MAX) {
     errno = EINVAL;
+    return -1;
+  }
+
+  const void *ptr;
+  if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &rd->solid_data) < 0)
+    return -1;
+
+  if (((uintptr_t)ptr & (sizeof(uint64_t) - 1)) != 0) {
+    rd->solid_data = malloc(sect->ssiz ? sect->ssiz : 1);
+    if (rd->solid_data == NULL)
+      return -1;
+    memcpy(rd->solid_data, ptr, sect->ssiz);
+    ptr = rd->solid_data;
+  }
+
+  rd->solid = ptr;
+  rd->solid_count = sect->ssiz / sizeof(struct ba_solid_block);
+
+  rd->blocks = malloc(sizeof(*rd->blocks));
+  if (rd->blocks == NULL)
+    return -1;
+
+  if (ba_cache_init(rd->blocks, BA_READER_BLOCKS) < 0) {
+    free(rd->blocks);
+    rd->blocks = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int reader_load_update(ba_reader_t *rd) {
+  const struct ba_section_header *sect = reader_section(rd, BA_SECTION_UPDATE);
+  if (sect == NULL)
     return 0;
+
+  if (sect->ssiz != sizeof(rd->update)) {
+    errno = EINVAL;
+    return -1;
   }
 
-  return rd->ehdr[id].bosz;
+  const void *ptr;
+  void *data;
+  if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &data) < 0)
+    return -1;
+
+  memcpy(&rd->update, ptr, sizeof(rd->update));
+  free(data);
+
+  return 0;
 }
 
-int ba_reader_read(ba_reader_t *rd, ba_id_t id, void *ptr) {
-  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL) {
+static int reader_load_sources(ba_reader_t *rd) {
+  const struct ba_section_header *sect = reader_section(rd, BA_SECTION_SOURCE);
+  if (sect == NULL)
+    return 0;
+
+  if (sect->ssiz != rd->ahdr->ensz * sizeof(struct ba_source_info)) {
     errno = EINVAL;
     return -1;
   }
 
-  z_stream strm = {0};
-  if (inflateInit(&strm) != Z_OK) {
-    errno = EIO;
+  const void *ptr;
+  if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &rd->sources_data) < 0)
     return -1;
+
+  if (((uintptr_t)ptr & (sizeof(uint64_t) - 1)) != 0) {
+    rd->sources_data = malloc(sect->ssiz ? sect->ssiz : 1);
+    if (rd->sources_data == NULL)
+      return -1;
+    memcpy(rd->sources_data, ptr, sect->ssiz);
+    ptr = rd->sources_data;
   }
 
-  strm.next_in = &((uint8_t *)rd->data)[rd->ehdr[id].boff];
-  strm.avail_in = rd->ehdr[id].bcsz;
-  strm.next_out = ptr;
-  strm.avail_out = rd->ehdr[id].bosz;
+  rd->sources = ptr;
 
-  do {
-    int ret = inflate(&strm, Z_FINISH);
-    if (ret == Z_STREAM_END)
-      break;
-    else if (ret != Z_OK) {
-      errno = EIO;
-      inflateEnd(&strm);
+  return 0;
+}
+
+static int reader_load_preload(ba_reader_t *rd) {
+  const struct ba_section_header *sect =
+      reader_section(rd, BA_SECTION_PRELOAD);
+  if (sect == NULL)
+    return 0;
+
+  if (sect->ssiz % sizeof(*rd->preload) != 0 ||
+      sect->ssiz / sizeof(*rd->preload) > UINT32_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint32_t count = sect->ssiz / sizeof(*rd->preload);
+  if (count == 0)
+    return 0;
+
+  const void *ptr;
+  void *data;
+  if (reader_fetch(rd, sect->soff, sect->ssiz, &ptr, &data) < 0)
+    return -1;
+
+  rd->preload = malloc(sect->ssiz);
+  if (rd->preload == NULL) {
+    free(data);
+    return -1;
+  }
+
+  memcpy(rd->preload, ptr, sect->ssiz);
+  free(data);
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (rd->preload[i].boff > rd->size ||
+        rd->size - rd->preload[i].boff < rd->preload[i].bsiz) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (rd->preload[i].bsiz != 0)
+      rd->preload_count = i + 1;
+  }
+
+  return 0;
+}
+
+static int reader_load(ba_reader_t *rd) {
+  if (reader_load_hash(rd) < 0)
+    return -1;
+
+  if (reader_load_dict(rd) < 0)
+    return -1;
+
+  if (reader_load_solid(rd) < 0)
+    return -1;
+
+  if (reader_load_update(rd) < 0)
+    return -1;
+
+  if (reader_load_sources(rd) < 0)
+    return -1;
+
+  return reader_load_preload(rd);
+}
+
+void ba_reader_free(ba_reader_t **rd) {
+  if (rd == NULL || *rd == NULL) {
+    errno = EINVAL;
+    return;
+  }
+
+  if ((*rd)->async != NULL) {
+    struct ba_async *async = (*rd)->async;
+    ba_mutex_lock(&async->lock);
+    async->stop = 1;
+    ba_cond_broadcast(&async->cond);
+    ba_mutex_unlock(&async->lock);
+    for (uint32_t i = 0; i < async->count; i++)
+      ba_thread_join(&async->workers[i]);
+
+    ba_cond_destroy(&async->done);
+    ba_cond_destroy(&async->cond);
+    ba_mutex_destroy(&async->lock);
+    free(async->spans);
+    free(async->heap);
+    free(async->workers);
+    free(async);
+  }
+
+  if ((*rd)->warm != NULL) {
+    struct ba_warm *warm = (*rd)->warm;
+    ba_mutex_lock(&warm->lock);
+    warm->stop = 1;
+    ba_mutex_unlock(&warm->lock);
+    ba_thread_join(&warm->thread);
+
+    for (uint32_t i = 0; i < (*rd)->ahdr->ensz; i++)
+      free(warm->data[i]);
+    ba_mutex_destroy(&warm->lock);
+    free(warm->data);
+    free(warm);
+  }
+
+  if ((*rd)->entries != NULL) {
+    ba_lru_destroy((*rd)->entries);
+    free((*rd)->entries);
+  }
+
+  free((*rd)->hash_data);
+  free((*rd)->dict_data);
+  free((*rd)->solid_data);
+  free((*rd)->sources_data);
+  free((*rd)->preload);
+  if ((*rd)->trace != NULL) {
+    ba_mutex_destroy(&(*rd)->trace->lock);
+    free((*rd)->trace->seen);
+    free((*rd)->trace->ids);
+    free((*rd)->trace);
+  }
+  if ((*rd)->blocks != NULL) {
+    ba_cache_destroy((*rd)->blocks);
+    free((*rd)->blocks);
+  }
+  free((*rd)->ehdr_data);
+  free((*rd)->data);
+  unmap_file((*rd)->map, (*rd)->map_size);
+  if ((*rd)->own_buf)
+    ba_buffer_free(&(*rd)->buf);
+  ba_mutex_destroy(&(*rd)->lock);
+
+  free(*rd);
+
+  *rd = NULL;
+}
+
+static int reader_open_lazy(ba_reader_t *rd, ba_buffer_t *buf) {
+  uint64_t size = ba_buffer_size(buf);
+  if (size == 0)
+    return -1;
+
+  uint8_t head[sizeof(struct ba_archive_header) +
+               sizeof(struct ba_archive_extension)];
+  uint64_t head_size = ba_buffer_pread(buf, head, sizeof(head), 0);
+  if (head_size == ~0ULL)
+    return -1;
+
+  uint64_t off = 0;
+  uint64_t avail = size;
+  if (head_trailing(head, head_size)) {
+    size = trailing_end(head, size);
+
+    struct ba_archive_footer foot;
+    if (size < sizeof(foot) ||
+        ba_buffer_pread(buf, &foot, sizeof(foot), size - sizeof(foot)) !=
+            sizeof(foot)) {
+      errno = EINVAL;
       return -1;
     }
-  } while (1);
 
-  inflateEnd(&strm);
+    if (footer_offset(&foot, size, &off) < 0)
+      return -1;
+    avail = size - sizeof(foot) - off;
+
+    head_size = ba_buffer_pread(buf, head, sizeof(head), off);
+    if (head_size == ~0ULL)
+      return -1;
+  }
+
+  uint64_t isz;
+  if (index_size(head, head_size, avail, &isz) < 0)
+    return -1;
+
+  rd->data = malloc(isz);
+  if (rd->data == NULL)
+    return -1;
+
+  if (ba_buffer_pread(buf, rd->data, isz, off) != isz) {
+    errno = EIO;
+    return -1;
+  }
+
+  if (reader_attach(rd, rd->data, isz) < 0)
+    return -1;
+
+  rd->buf = buf;
+  rd->base = NULL;
+  rd->size = size;
+
+  return reader_load(rd);
+}
+
+int ba_reader_open(ba_reader_t *rd, ba_buffer_t *buf) {
+  return ba_reader_open_ex(rd, buf, 0);
+}
+
+static int reader_open_buffer(ba_reader_t *rd, ba_buffer_t *buf,
+                              uint32_t flags) {
+  if (flags & BA_READER_LAZY)
+    return reader_open_lazy(rd, buf);
+
+  uint64_t size = ba_buffer_size(buf);
+  if (size == 0)
+    return -1;
+
+  if (ba_buffer_seek(buf, 0, SEEK_SET) < 0)
+    return -1;
+
+  rd->data = malloc(size);
+  if (rd->data == NULL)
+    return -1;
+
+  if (ba_buffer_read(buf, rd->data, size) < size)
+    return -1;
+
+  uint64_t off, avail, end;
+  if (reader_locate(rd->data, size, &off, &avail, &end) < 0)
+    return -1;
+
+  if (reader_attach(rd, (const uint8_t *)rd->data + off, avail) < 0)
+    return -1;
+
+  rd->base = rd->data;
+  rd->size = end;
+
+  return reader_load(rd);
+}
+
+static void reader_readahead(const ba_reader_t *rd, const char *filename) {
+  if (rd->preload_count == 0)
+    return;
+
+#ifdef _WIN32
+  (void)filename;
+#else
+  if (rd->map != NULL) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    for (uint32_t i = 0; i < rd->preload_count; i++) {
+      const struct ba_preload_info *region = &rd->preload[i];
+      if (region->bsiz == 0)
+        continue;
+
+      uint64_t start = region->boff & ~(page - 1);
+      madvise((uint8_t *)rd->map + start, region->boff + region->bsiz - start,
+              MADV_WILLNEED);
+    }
+    return;
+  }
+
+  if (filename == NULL || rd->base != NULL)
+    return;
+
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  for (uint32_t i = 0; i < rd->preload_count; i++)
+    if (rd->preload[i].bsiz != 0)
+      posix_fadvise(fd, rd->preload[i].boff, rd->preload[i].bsiz,
+                    POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+#endif
+}
+
+static int reader_decode(const ba_reader_t *rd, ba_id_t id, void *ptr);
+
+static void warm_main(void *arg) {
+  ba_reader_t *rd = arg;
+  struct ba_warm *warm = rd->warm;
+  uint64_t left = BA_WARM_BUDGET;
+
+  for (ba_id_t id = 0; id < rd->ahdr->ensz; id++) {
+    if (!(rd->ehdr[id].flag & BA_ENTRY_PRELOAD) || rd->ehdr[id].bosz > left)
+      continue;
+
+    ba_mutex_lock(&warm->lock);
+    int stop = warm->stop;
+    ba_mutex_unlock(&warm->lock);
+    if (stop)
+      return;
+
+    void *data = malloc(rd->ehdr[id].bosz ? rd->ehdr[id].bosz : 1);
+    if (data == NULL)
+      return;
+
+    if (reader_decode(rd, id, data) < 0) {
+      free(data);
+      continue;
+    }
+    left -= rd->ehdr[id].bosz;
+
+    ba_mutex_lock(&warm->lock);
+    warm->data[id] = data;
+    ba_mutex_unlock(&warm->lock);
+  }
+}
+
+static int reader_preload(ba_reader_t *rd, const char *filename,
+                          uint32_t flags) {
+  if (!(flags & (BA_READER_PRELOAD | BA_READER_PRELOAD_DECODE)))
+    return 0;
+
+  reader_readahead(rd, filename);
+
+  if (!(flags & BA_READER_PRELOAD_DECODE) || rd->preload_count == 0)
+    return 0;
+
+  struct ba_warm *warm = calloc(1, sizeof(*warm));
+  if (warm == NULL)
+    return -1;
+
+  warm->data = calloc(rd->ahdr->ensz, sizeof(*warm->data));
+  if (warm->data == NULL) {
+    free(warm);
+    return -1;
+  }
+
+  if (ba_mutex_init(&warm->lock) < 0) {
+    free(warm->data);
+    free(warm);
+    return -1;
+  }
+
+  rd->warm = warm;
+  if (ba_thread_create(&warm->thread, warm_main, rd) < 0) {
+    rd->warm = NULL;
+    ba_mutex_destroy(&warm->lock);
+    free(warm->data);
+    free(warm);
+    return -1;
+  }
+
+  return 0;
+}
+
+static const void *reader_warm(const ba_reader_t *rd, ba_id_t id) {
+  if (rd->warm == NULL || !(rd->ehdr[id].flag & BA_ENTRY_PRELOAD))
+    return NULL;
+
+  ba_mutex_lock(&rd->warm->lock);
+  const void *data = rd->warm->data[id];
+  ba_mutex_unlock(&rd->warm->lock);
+
+  return data;
+}
+
+int ba_reader_open_ex(ba_reader_t *rd, ba_buffer_t *buf, uint32_t flags) {
+  if (rd == NULL || buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (reader_open_buffer(rd, buf, flags) < 0)
+    return -1;
+
+  return reader_preload(rd, NULL, flags);
+}
+
+int ba_reader_open_file(ba_reader_t *rd, const char *filename) {
+  return ba_reader_open_file_ex(rd, filename, 0);
+}
+
+int ba_reader_open_file_ex(ba_reader_t *rd, const char *filename,
+                           uint32_t flags) {
+  if (rd == NULL || filename == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!(flags & BA_READER_LAZY) &&
+      map_file(filename, &rd->map, &rd->map_size) == 0) {
+    uint64_t off, avail, end;
+    if (reader_locate(rd->map, rd->map_size, &off, &avail, &end) < 0)
+      return -1;
+
+    if (reader_attach(rd, (const uint8_t *)rd->map + off, avail) < 0)
+      return -1;
+
+    rd->base = rd->map;
+    rd->size = end;
+
+    if (reader_load(rd) < 0)
+      return -1;
+
+    return reader_preload(rd, filename, flags);
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+
+  if (reader_open_buffer(rd, buf, flags) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (flags & BA_READER_LAZY)
+    rd->own_buf = 1;
+  else
+    ba_buffer_free(&buf);
+
+  return reader_preload(rd, filename, flags);
+}
+
+uint32_t ba_reader_size(const ba_reader_t *rd) {
+  if (rd == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  return rd->ahdr->ensz;
+}
+
+ba_id_t ba_reader_find_entry(const ba_reader_t *rd, const char *entry,
+                             uint64_t entry_len) {
+  if (rd == NULL || entry == NULL) {
+    errno = EINVAL;
+    return BA_ENTRY_INVALID;
+  }
+
+  if (entry_len == 0)
+    entry_len = strlen(entry);
+
+  uint32_t hash = ba_hash(entry, entry_len);
+  uint32_t mask = rd->hcap - 1;
+  for (uint32_t i = 0, j = hash & mask; i < rd->hcap; i++, j = (j + 1) & mask) {
+    ba_id_t id = rd->hash[j].id;
+    if (id == BA_ENTRY_INVALID)
+      break;
+
+    if (id < rd->ahdr->ensz && rd->hash[j].hash == hash &&
+        entry_len == rd->ehdr[id].tlen &&
+        memcmp(entry, &rd->tble[rd->ehdr[id].tidx], entry_len) == 0)
+      return id;
+  }
+
+  errno = ENOENT;
+  return BA_ENTRY_INVALID;
+}
+
+int ba_reader_entry_name(const ba_reader_t *rd, ba_id_t id, const char **str,
+                         uint64_t *len) {
+  if (rd == NULL || id >= rd->ahdr->ensz || str == NULL || len == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *str = &rd->tble[rd->ehdr[id].tidx];
+  *len = rd->ehdr[id].tlen;
+
+  return 0;
+}
+
+uint64_t ba_reader_entry_size(const ba_reader_t *rd, ba_id_t id) {
+  if (rd == NULL || id >= rd->ahdr->ensz) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  return rd->ehdr[id].bosz;
+}
+
+uint64_t ba_reader_dead_size(const ba_reader_t *rd) {
+  if (rd == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  return rd->update.dead;
+}
+
+static int payload_compare(const void *lhs, const void *rhs) {
+  const struct ba_entry_header *a = *(const struct ba_entry_header *const *)lhs;
+  const struct ba_entry_header *b = *(const struct ba_entry_header *const *)rhs;
+
+  int sa = a->codc == BA_ENTRY_SOLID, sb = b->codc == BA_ENTRY_SOLID;
+  if (sa != sb)
+    return sa < sb ? -1 : 1;
+  if (sa && a->bksz != b->bksz)
+    return a->bksz < b->bksz ? -1 : 1;
+  if (a->boff != b->boff)
+    return a->boff < b->boff ? -1 : 1;
+  if (sa && a->bosz != b->bosz)
+    return a->bosz < b->bosz ? -1 : 1;
+  if (!sa && a->bcsz != b->bcsz)
+    return a->bcsz < b->bcsz ? -1 : 1;
+  return 0;
+}
+
+uint64_t ba_reader_dedup_size(const ba_reader_t *rd) {
+  if (rd == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  if (rd->ahdr->ensz < 2)
+    return 0;
+
+  const struct ba_entry_header **order =
+      malloc(rd->ahdr->ensz * sizeof(*order));
+  if (order == NULL)
+    return 0;
+
+  for (ba_id_t id = 0; id < rd->ahdr->ensz; id++)
+    order[id] = &rd->ehdr[id];
+  qsort(order, rd->ahdr->ensz, sizeof(*order), payload_compare);
+
+  uint64_t saved = 0;
+  for (ba_id_t i = 1; i < rd->ahdr->ensz; i++)
+    if (payload_compare(&order[i - 1], &order[i]) == 0)
+      saved += order[i]->codc == BA_ENTRY_SOLID ? order[i]->bosz
+                                                 : order[i]->bcsz;
+
+  free(order);
+
+  return saved;
+}
+
+static int reader_block_offset(const struct ba_entry_stream *st, ba_id_t id,
+                               uint64_t idx, uint64_t *off) {
+  const ba_reader_t *rd = st->rd;
+  const struct ba_entry_header *ehdr = &rd->ehdr[id];
+  uint64_t blocks = (ehdr->bosz + ehdr->bksz - 1) / ehdr->bksz;
+  uint64_t table = (blocks + 1) * sizeof(*off);
+
+  if (ehdr->bcsz < table) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint64_t pos = ehdr->boff + ehdr->bcsz - table + idx * sizeof(*off);
+  if (st->src != NULL)
+    memcpy(off, &st->src[pos - st->src_off], sizeof(*off));
+  else if (ba_buffer_pread(rd->buf, off, sizeof(*off), pos) != sizeof(*off)) {
+    errno = EIO;
+    return -1;
+  }
+
+  if (*off > ehdr->bcsz - table) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int stream_begin(struct ba_entry_stream *st) {
+  if (st->src == NULL) {
+    st->chunk = malloc(BA_STREAM_CHUNK);
+    if (st->chunk == NULL)
+      return -1;
+  }
+
+  st->strm = ba_inflater_acquire();
+  if (st->strm == NULL) {
+    free(st->chunk);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void stream_end(struct ba_entry_stream *st) {
+  ba_inflater_release(st->strm);
+  free(st->chunk);
+  if (st->block != NULL)
+    ba_cache_release(st->rd->blocks, st->block);
+}
+
+static uint64_t stream_inflate(struct ba_entry_stream *st, void *ptr,
+                               uint64_t size) {
+  uint64_t done = 0;
+
+  while (done < size && !st->done) {
+    if (st->strm->avail_in == 0 && st->left > 0) {
+      uint64_t n;
+      if (st->src != NULL) {
+        n = st->left > UINT_MAX ? UINT_MAX : st->left;
+        st->strm->next_in = (Bytef *)&st->src[st->next - st->src_off];
+      } else {
+        n = st->left > BA_STREAM_CHUNK ? BA_STREAM_CHUNK : st->left;
+        if (ba_buffer_pread(st->rd->buf, st->chunk, n, st->next) != n) {
+          errno = EIO;
+          return ~0ULL;
+        }
+        st->strm->next_in = st->chunk;
+      }
+      st->strm->avail_in = n;
+      st->next += n;
+      st->left -= n;
+    }
+
+    uint64_t n = size - done > UINT_MAX ? UINT_MAX : size - done;
+    st->strm->next_out = &((Bytef *)ptr)[done];
+    st->strm->avail_out = n;
+
+    int ret = inflate(st->strm, Z_NO_FLUSH);
+    done += n - st->strm->avail_out;
+    if (ret == Z_NEED_DICT) {
+      if (st->rd->dict == NULL ||
+          inflateSetDictionary(st->strm, st->rd->dict, st->rd->dict_len) !=
+              Z_OK) {
+        errno = EIO;
+        return ~0ULL;
+      }
+    } else if (ret == Z_STREAM_END) {
+      if (st->blocks == 0) {
+        st->done = 1;
+      } else if (inflateReset(st->strm) == Z_OK) {
+        st->blocks--;
+      } else {
+        errno = EIO;
+        return ~0ULL;
+      }
+    } else if (ret != Z_OK) {
+      errno = EIO;
+      return ~0ULL;
+    }
+  }
+
+  return done;
+}
+
+static struct ba_cache_item *reader_block(const ba_reader_t *rd, uint32_t b,
+                                          const uint8_t *src,
+                                          uint64_t src_off) {
+  struct ba_cache_item *item = ba_cache_get(rd->blocks, b);
+  if (item != NULL)
+    return item;
+
+  const struct ba_solid_block *blk = &rd->solid[b];
+  if (blk->boff > rd->size || rd->size - blk->boff < blk->bcsz ||
+      blk->codc != BA_ENTRY_DEFLATE) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  item = ba_cache_item_alloc(b, blk->bosz);
+  if (item == NULL)
+    return NULL;
+
+  struct ba_entry_stream st;
+  memset(&st, 0, sizeof(st));
+  st.rd = rd;
+  st.next = blk->boff;
+  st.left = blk->bcsz;
+  st.src = src;
+  st.src_off = src_off;
+
+  if (stream_begin(&st) < 0) {
+    free(item);
+    return NULL;
+  }
+
+  uint8_t extra;
+  uint64_t size = stream_inflate(&st, item->data, blk->bosz);
+  if (size != blk->bosz || (!st.done && stream_inflate(&st, &extra, 1) != 0)) {
+    stream_end(&st);
+    free(item);
+    errno = EIO;
+    return NULL;
+  }
+
+  stream_end(&st);
+
+  return ba_cache_put(rd->blocks, item);
+}
+
+static int stream_from(struct ba_entry_stream *st, const ba_reader_t *rd,
+                       ba_id_t id, uint64_t offset, const uint8_t *src,
+                       uint64_t src_off) {
+  const struct ba_entry_header *ehdr = &rd->ehdr[id];
+
+  if (ehdr->codc == BA_ENTRY_SOLID) {
+    if (ehdr->bksz >= rd->solid_count ||
+        ehdr->boff > rd->solid[ehdr->bksz].bosz ||
+        rd->solid[ehdr->bksz].bosz - ehdr->boff < ehdr->bosz ||
+        offset > ehdr->bosz) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->rd = rd;
+    st->next = ehdr->boff + offset;
+    st->left = ehdr->bosz - offset;
+
+    st->block = reader_block(rd, ehdr->bksz, src, src_off);
+    if (st->block == NULL)
+      return -1;
+
+    return 0;
+  }
+
+  if (ehdr->boff > rd->size || rd->size - ehdr->boff < ehdr->bcsz ||
+      offset > ehdr->bosz) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(st, 0, sizeof(*st));
+  st->rd = rd;
+  st->next = ehdr->boff;
+  st->left = ehdr->bcsz;
+  st->skip = offset;
+  st->src = src;
+  st->src_off = src_off;
+
+  if (ehdr->codc == BA_ENTRY_STORE) {
+    if (ehdr->bcsz != ehdr->bosz) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    st->next += offset;
+    st->left -= offset;
+    st->skip = 0;
+
+    return 0;
+  }
+
+  if (ehdr->codc != BA_ENTRY_DEFLATE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (ehdr->flag & BA_ENTRY_BLOCKS) {
+    if (ehdr->bksz == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    uint64_t blocks = (ehdr->bosz + ehdr->bksz - 1) / ehdr->bksz;
+    uint64_t block = offset / ehdr->bksz;
+    if (block >= blocks)
+      block = blocks ? blocks - 1 : 0;
+
+    uint64_t start, end;
+    if (reader_block_offset(st, id, block, &start) < 0 ||
+        reader_block_offset(st, id, blocks, &end) < 0)
+      return -1;
+    if (start > end) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    st->next = ehdr->boff + start;
+    st->left = end - start;
+    st->skip = offset - block * ehdr->bksz;
+    st->blocks = blocks ? blocks - block - 1 : 0;
+  }
+
+  return stream_begin(st);
+}
+
+static int stream_init(struct ba_entry_stream *st, const ba_reader_t *rd,
+                       ba_id_t id, uint64_t offset) {
+  return stream_from(st, rd, id, offset, rd->base, 0);
+}
+
+static uint64_t stream_copy(struct ba_entry_stream *st, void *ptr,
+                            uint64_t size) {
+  uint64_t n = size > st->left ? st->left : size;
+
+  if (st->block != NULL)
+    memcpy(ptr, &st->block->data[st->next], n);
+  else if (st->src != NULL)
+    memcpy(ptr, &st->src[st->next - st->src_off], n);
+  else if (ba_buffer_pread(st->rd->buf, ptr, n, st->next) != n) {
+    errno = EIO;
+    return ~0ULL;
+  }
+
+  st->next += n;
+  st->left -= n;
+  st->done = st->left == 0;
+
+  return n;
+}
+
+static uint64_t stream_read(struct ba_entry_stream *st, void *ptr,
+                            uint64_t size) {
+  if (st->strm == NULL)
+    return stream_copy(st, ptr, size);
+
+  while (st->skip > 0) {
+    uint8_t scratch[4096];
+    uint64_t n = st->skip > sizeof(scratch) ? sizeof(scratch) : st->skip;
+    uint64_t got = stream_inflate(st, scratch, n);
+    if (got == ~0ULL)
+      return ~0ULL;
+    if (got < n) {
+      errno = EIO;
+      return ~0ULL;
+    }
+    st->skip -= got;
+  }
+
+  return stream_inflate(st, ptr, size);
+}
+
+int ba_reader_set_trace(ba_reader_t *rd, int enable) {
+  if (rd == NULL || rd->ahdr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (rd->trace == NULL && enable) {
+    struct ba_trace *trace = calloc(1, sizeof(*trace));
+    if (trace == NULL)
+      return -1;
+
+    trace->seen = calloc(rd->ahdr->ensz + 1, sizeof(*trace->seen));
+    trace->ids = malloc((rd->ahdr->ensz + 1) * sizeof(*trace->ids));
+    if (trace->seen == NULL || trace->ids == NULL) {
+      free(trace->ids);
+      free(trace->seen);
+      free(trace);
+      return -1;
+    }
+
+    if (ba_mutex_init(&trace->lock) < 0) {
+      free(trace->ids);
+      free(trace->seen);
+      free(trace);
+      return -1;
+    }
+
+    rd->trace = trace;
+  }
+
+  if (rd->trace != NULL)
+    rd->trace->on = enable != 0;
+
+  return 0;
+}
+
+static void reader_touch(const ba_reader_t *rd, ba_id_t id) {
+  struct ba_trace *trace = rd->trace;
+  if (trace == NULL || !trace->on)
+    return;
+
+  ba_mutex_lock(&trace->lock);
+  if (!trace->seen[id]) {
+    trace->seen[id] = 1;
+    trace->ids[trace->size++] = id;
+  }
+  ba_mutex_unlock(&trace->lock);
+}
+
+int ba_reader_write_trace(ba_reader_t *rd, ba_buffer_t *buf) {
+  if (rd == NULL || buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_trace *trace = rd->trace;
+  if (trace == NULL)
+    return 0;
+
+  int ret = 0;
+  ba_mutex_lock(&trace->lock);
+  for (uint32_t i = 0; ret == 0 && i < trace->size; i++) {
+    const struct ba_entry_header *ehdr = &rd->ehdr[trace->ids[i]];
+    if (ba_buffer_write(buf, &rd->tble[ehdr->tidx], ehdr->tlen) < 0 ||
+        ba_buffer_write(buf, "\n", 1) < 0)
+      ret = -1;
+  }
+  ba_mutex_unlock(&trace->lock);
+
+  return ret;
+}
+
+int ba_reader_write_trace_file(ba_reader_t *rd, const char *filename) {
+  if (rd == NULL || filename == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "wb") < 0)
+    return -1;
+
+  if (ba_reader_write_trace(rd, buf) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  ba_buffer_free(&buf);
+
+  return 0;
+}
+
+int ba_reader_entry_data(const ba_reader_t *rd, ba_id_t id,
+                         const void **ptr) {
+  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reader_touch(rd, id);
+
+  const struct ba_entry_header *ehdr = &rd->ehdr[id];
+  if (ehdr->codc != BA_ENTRY_STORE || rd->base == NULL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  if (ehdr->bcsz != ehdr->bosz || ehdr->boff > rd->size ||
+      rd->size - ehdr->boff < ehdr->bcsz) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *ptr = &rd->base[ehdr->boff];
+
+  return 0;
+}
+
+static int reader_decode_from(const ba_reader_t *rd, ba_id_t id, void *ptr,
+                              const uint8_t *src, uint64_t src_off) {
+  struct ba_entry_stream st;
+  if (stream_from(&st, rd, id, 0, src, src_off) < 0)
+    return -1;
+
+  uint64_t size = stream_read(&st, ptr, rd->ehdr[id].bosz);
+  if (size == ~0ULL) {
+    stream_end(&st);
+    return -1;
+  }
+
+  uint8_t extra;
+  if (size != rd->ehdr[id].bosz ||
+      (!st.done && stream_read(&st, &extra, 1) != 0)) {
+    stream_end(&st);
+    errno = EIO;
+    return -1;
+  }
+
+  stream_end(&st);
+
+  return 0;
+}
+
+static int reader_decode(const ba_reader_t *rd, ba_id_t id, void *ptr) {
+  return reader_decode_from(rd, id, ptr, rd->base, 0);
+}
+
+static int reader_fill(const ba_reader_t *rd, ba_id_t id, void *ptr) {
+  const void *data = reader_warm(rd, id);
+  if (data != NULL) {
+    memcpy(ptr, data, rd->ehdr[id].bosz);
+    return 0;
+  }
+
+  return reader_decode(rd, id, ptr);
+}
+
+int ba_reader_read(ba_reader_t *rd, ba_id_t id, void *ptr) {
+  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reader_touch(rd, id);
+
+  return reader_fill(rd, id, ptr);
+}
+
+static int batch_compare(const void *lhs, const void *rhs) {
+  const struct ba_read_slot *a = lhs;
+  const struct ba_read_slot *b = rhs;
+
+  if (a->boff != b->boff)
+    return a->boff < b->boff ? -1 : 1;
+  if (a->skip != b->skip)
+    return a->skip < b->skip ? -1 : 1;
+  return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+static void batch_done(struct ba_read_pool *pool, uint32_t i, int err) {
+  if (pool->errs != NULL)
+    pool->errs[i] = err;
+
+  if (err != 0 && pool->err == 0)
+    pool->err = err;
+}
+
+static void batch_inline(struct ba_read_pool *pool) {
+  for (uint32_t k = 0; k < pool->count; k++) {
+    uint32_t i = pool->slots[k].idx;
+    ba_id_t id = pool->ids[i];
+
+    int err = 0;
+    if (id >= pool->rd->ahdr->ensz || pool->ptrs[i] == NULL)
+      err = EINVAL;
+    else if (reader_fill(pool->rd, id, pool->ptrs[i]) < 0)
+      err = errno ? errno : EIO;
+
+    batch_done(pool, i, err);
+  }
+}
+
+int ba_reader_set_threads(ba_reader_t *rd, uint32_t threads) {
+  if (rd == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  rd->threads = threads;
+
+  return 0;
+}
+
+static int request_before(const struct ba_read_request *a,
+                          const struct ba_read_request *b) {
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+
+  uint64_t da = a->deadline ? a->deadline : UINT64_MAX;
+  uint64_t db = b->deadline ? b->deadline : UINT64_MAX;
+  if (da != db)
+    return da < db;
+
+  return a->seq < b->seq;
+}
+
+static void heap_set(struct ba_async *async, uint32_t i,
+                     struct ba_read_request *req) {
+  async->heap[i] = req;
+  req->slot = i;
+}
+
+static void heap_up(struct ba_async *async, uint32_t i) {
+  struct ba_read_request *req = async->heap[i];
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (!request_before(req, async->heap[parent]))
+      break;
+    heap_set(async, i, async->heap[parent]);
+    i = parent;
+  }
+  heap_set(async, i, req);
+}
+
+static void heap_down(struct ba_async *async, uint32_t i) {
+  struct ba_read_request *req = async->heap[i];
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= async->size)
+      break;
+    if (child + 1 < async->size &&
+        request_before(async->heap[child + 1], async->heap[child]))
+      child++;
+    if (!request_before(async->heap[child], req))
+      break;
+    heap_set(async, i, async->heap[child]);
+    i = child;
+  }
+  heap_set(async, i, req);
+}
+
+static uint32_t span_find(const struct ba_async *async, uint64_t lo,
+                          uint64_t seq) {
+  uint32_t first = 0, last = async->size;
+  while (first < last) {
+    uint32_t mid = first + (last - first) / 2;
+    const struct ba_read_request *req = async->spans[mid];
+    if (req->lo < lo || (req->lo == lo && req->seq < seq))
+      first = mid + 1;
+    else
+      last = mid;
+  }
+
+  return first;
+}
+
+static int async_reserve(struct ba_async *async, uint32_t extra) {
+  if (async->size + extra <= async->cap)
+    return 0;
+
+  uint32_t cap = async->cap ? async->cap : 64;
+  while (cap < async->size + extra)
+    cap *= 2;
+
+  struct ba_read_request **heap = realloc(async->heap, cap * sizeof(*heap));
+  if (heap == NULL)
+    return -1;
+  async->heap = heap;
+
+  struct ba_read_request **spans = realloc(async->spans, cap * sizeof(*spans));
+  if (spans == NULL)
+    return -1;
+  async->spans = spans;
+
+  async->cap = cap;
+
+  return 0;
+}
+
+static void async_push(struct ba_async *async, struct ba_read_request *req) {
+  uint32_t pos = span_find(async, req->lo, req->seq);
+  memmove(&async->spans[pos + 1], &async->spans[pos],
+          (async->size - pos) * sizeof(*async->spans));
+  async->spans[pos] = req;
+
+  heap_set(async, async->size++, req);
+  heap_up(async, req->slot);
+}
+
+static void async_remove(struct ba_async *async, uint32_t pos) {
+  struct ba_read_request *req = async->spans[pos];
+  memmove(&async->spans[pos], &async->spans[pos + 1],
+          (async->size - pos - 1) * sizeof(*async->spans));
+
+  uint32_t i = req->slot;
+  async->size--;
+  if (i != async->size) {
+    heap_set(async, i, async->heap[async->size]);
+    heap_up(async, i);
+    heap_down(async, i);
+  }
+
+  req->next = NULL;
+  req->state = BA_READ_RUNNING;
+}
+
+static void async_start(struct ba_async *async, struct ba_read_request *req,
+                        uint64_t now) {
+  if (req->deadline != 0 && now > req->deadline)
+    async->late++;
+}
+
+static struct ba_read_request *async_take(struct ba_async *async) {
+  uint64_t now = ba_time_ms();
+
+  struct ba_read_request *group = async->heap[0];
+  uint32_t pos = span_find(async, group->lo, group->seq);
+  async_remove(async, pos);
+  async_start(async, group, now);
+
+  struct ba_read_request *tail = group;
+  uint64_t lo = group->lo, hi = group->hi;
+  while (pos < async->size) {
+    struct ba_read_request *req = async->spans[pos];
+    uint64_t nhi = req->hi > hi ? req->hi : hi;
+    if (req->lo > hi + BA_READ_GAP || nhi - lo > BA_READ_SPAN)
+      break;
+
+    async_remove(async, pos);
+    async_start(async, req, now);
+    tail->next = req;
+    tail = req;
+    hi = nhi;
+    async->merged++;
+  }
+
+  while (pos > 0) {
+    struct ba_read_request *req = async->spans[pos - 1];
+    uint64_t nlo = req->lo < lo ? req->lo : lo;
+    uint64_t nhi = req->hi > hi ? req->hi : hi;
+    if (req->hi + BA_READ_GAP < lo || nhi - nlo > BA_READ_SPAN)
+      break;
+
+    async_remove(async, --pos);
+    async_start(async, req, now);
+    tail->next = req;
+    tail = req;
+    lo = nlo;
+    hi = nhi;
+    async->merged++;
+  }
+
+  return group;
+}
+
+static void async_run(const ba_reader_t *rd, struct ba_read_request *group) {
+  uint64_t lo = group->lo, hi = group->hi;
+  for (struct ba_read_request *req = group->next; req != NULL;
+       req = req->next) {
+    if (req->lo < lo)
+      lo = req->lo;
+    if (req->hi > hi)
+      hi = req->hi;
+  }
+
+  uint8_t *scratch = NULL;
+  const uint8_t *src = rd->base;
+  uint64_t src_off = 0;
+  if (rd->base == NULL && group->next != NULL && hi > lo) {
+    scratch = malloc(hi - lo);
+    if (scratch != NULL &&
+        ba_buffer_pread(rd->buf, scratch, hi - lo, lo) == hi - lo) {
+      src = scratch;
+      src_off = lo;
+    }
+  }
+
+  for (struct ba_read_request *req = group; req != NULL; req = req->next) {
+    const void *data = reader_warm(rd, req->id);
+    req->err = 0;
+    if (data != NULL)
+      memcpy(req->ptr, data, rd->ehdr[req->id].bosz);
+    else if (reader_decode_from(rd, req->id, req->ptr, src, src_off) < 0)
+      req->err = errno ? errno : EIO;
+
+    if (req->cb != NULL)
+      req->cb(req->arg, req->id, req->err);
+  }
+
+  free(scratch);
+}
+
+static void async_worker(void *arg) {
+  struct ba_async *async = arg;
+
+  ba_mutex_lock(&async->lock);
+  for (;;) {
+    while (async->size == 0 && !async->stop)
+      ba_cond_wait(&async->cond, &async->lock);
+    if (async->size == 0)
+      break;
+
+    struct ba_read_request *group = async_take(async);
+    ba_mutex_unlock(&async->lock);
+
+    async_run(async->rd, group);
+
+    ba_mutex_lock(&async->lock);
+    while (group != NULL) {
+      struct ba_read_request *req = group;
+      group = req->next;
+
+      if (req->pool != NULL) {
+        batch_done(req->pool, req->idx, req->err);
+        req->pool->left--;
+        continue;
+      }
+
+      async->completed++;
+      if (req->keep)
+        req->state = BA_READ_DONE;
+      else
+        free(req);
+    }
+    ba_cond_broadcast(&async->done);
+  }
+  ba_mutex_unlock(&async->lock);
+}
+
+static struct ba_async *reader_async(ba_reader_t *rd) {
+  ba_mutex_lock(&rd->lock);
+  if (rd->async != NULL) {
+    ba_mutex_unlock(&rd->lock);
+    return rd->async;
+  }
+
+  struct ba_async *async = calloc(1, sizeof(*async));
+  if (async == NULL) {
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  uint32_t threads = rd->threads ? rd->threads : 1;
+  async->rd = rd;
+  async->workers = calloc(threads, sizeof(*async->workers));
+  if (async->workers == NULL) {
+    free(async);
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  if (ba_mutex_init(&async->lock) < 0) {
+    free(async->workers);
+    free(async);
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  if (ba_cond_init(&async->cond) < 0) {
+    ba_mutex_destroy(&async->lock);
+    free(async->workers);
+    free(async);
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  if (ba_cond_init(&async->done) < 0) {
+    ba_cond_destroy(&async->cond);
+    ba_mutex_destroy(&async->lock);
+    free(async->workers);
+    free(async);
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  while (async->count < threads &&
+         ba_thread_create(&async->workers[async->count], async_worker,
+                          async) == 0)
+    async->count++;
+
+  if (async->count == 0) {
+    ba_cond_destroy(&async->done);
+    ba_cond_destroy(&async->cond);
+    ba_mutex_destroy(&async->lock);
+    free(async->workers);
+    free(async);
+    ba_mutex_unlock(&rd->lock);
+    return NULL;
+  }
+
+  rd->async = async;
+  ba_mutex_unlock(&rd->lock);
+
+  return async;
+}
+
+static void request_init(const ba_reader_t *rd, struct ba_read_request *item,
+                         ba_id_t id, void *ptr) {
+  const struct ba_entry_header *ehdr = &rd->ehdr[id];
+
+  item->rd = (ba_reader_t *)rd;
+  item->id = id;
+  item->ptr = ptr;
+  item->lo = ehdr->boff;
+  item->hi = ehdr->boff + ehdr->bcsz;
+  if (ehdr->codc == BA_ENTRY_SOLID && ehdr->bksz < rd->solid_count) {
+    item->lo = rd->solid[ehdr->bksz].boff;
+    item->hi = item->lo + rd->solid[ehdr->bksz].bcsz;
+  }
+  item->state = BA_READ_QUEUED;
+}
+
+static int batch_queue(struct ba_read_pool *pool) {
+  ba_reader_t *rd = pool->rd;
+
+  struct ba_async *async = reader_async(rd);
+  if (async == NULL)
+    return -1;
+
+  struct ba_read_request *items = calloc(pool->count, sizeof(*items));
+  if (items == NULL)
+    return -1;
+
+  ba_mutex_lock(&async->lock);
+  if (async_reserve(async, pool->count) < 0) {
+    ba_mutex_unlock(&async->lock);
+    free(items);
+    return -1;
+  }
+
+  for (uint32_t k = 0; k < pool->count; k++) {
+    uint32_t i = pool->slots[k].idx;
+    if (pool->ids[i] >= rd->ahdr->ensz || pool->ptrs[i] == NULL) {
+      batch_done(pool, i, EINVAL);
+      continue;
+    }
+
+    struct ba_read_request *item = &items[k];
+    request_init(rd, item, pool->ids[i], pool->ptrs[i]);
+    item->pool = pool;
+    item->idx = i;
+    item->seq = async->seq++;
+    async_push(async, item);
+    pool->left++;
+  }
+  ba_cond_broadcast(&async->cond);
+
+  while (pool->left != 0)
+    ba_cond_wait(&async->done, &async->lock);
+  ba_mutex_unlock(&async->lock);
+
+  free(items);
+
+  return 0;
+}
+
+int ba_reader_read_batch(ba_reader_t *rd, const ba_id_t *ids, uint32_t count,
+                         void *const *ptrs, int *errs) {
+  if (rd == NULL || (count != 0 && (ids == NULL || ptrs == NULL))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (count == 0)
+    return 0;
+
+  struct ba_read_pool pool = {0};
+  pool.rd = rd;
+  pool.ids = ids;
+  pool.ptrs = ptrs;
+  pool.errs = errs;
+  pool.count = count;
+
+  pool.slots = malloc(count * sizeof(*pool.slots));
+  if (pool.slots == NULL)
+    return -1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    struct ba_read_slot *slot = &pool.slots[i];
+    slot->boff = 0;
+    slot->skip = 0;
+    slot->idx = i;
+    if (ids[i] >= rd->ahdr->ensz)
+      continue;
+
+    reader_touch(rd, ids[i]);
+
+    const struct ba_entry_header *ehdr = &rd->ehdr[ids[i]];
+    slot->boff = ehdr->boff;
+    if (ehdr->codc == BA_ENTRY_SOLID && ehdr->bksz < rd->solid_count) {
+      slot->boff = rd->solid[ehdr->bksz].boff;
+      slot->skip = ehdr->boff;
+    }
+  }
+  qsort(pool.slots, count, sizeof(*pool.slots), batch_compare);
+
+  if (rd->threads <= 1 || count == 1 || batch_queue(&pool) < 0)
+    batch_inline(&pool);
+
+  free(pool.slots);
+
+  if (pool.err != 0) {
+    errno = pool.err;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ba_reader_read_async(ba_reader_t *rd, ba_id_t id, void *ptr,
+                         ba_read_callback cb, void *arg,
+                         ba_read_request_t **req) {
+  return ba_reader_read_async_ex(rd, id, ptr, 0, 0, cb, arg, req);
+}
+
+int ba_reader_read_async_ex(ba_reader_t *rd, ba_id_t id, void *ptr,
+                            int32_t priority, uint32_t timeout,
+                            ba_read_callback cb, void *arg,
+                            ba_read_request_t **req) {
+  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL ||
+      (cb == NULL && req == NULL)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_async *async = reader_async(rd);
+  if (async == NULL)
+    return -1;
+
+  struct ba_read_request *item = calloc(1, sizeof(*item));
+  if (item == NULL)
+    return -1;
+
+  request_init(rd, item, id, ptr);
+  item->cb = cb;
+  item->arg = arg;
+  item->priority = priority;
+  item->deadline = timeout ? ba_time_ms() + timeout : 0;
+  item->keep = req != NULL;
+
+  ba_mutex_lock(&async->lock);
+  if (async_reserve(async, 1) < 0) {
+    ba_mutex_unlock(&async->lock);
+    free(item);
+    return -1;
+  }
+
+  item->seq = async->seq++;
+  async_push(async, item);
+  ba_cond_signal(&async->cond);
+  ba_mutex_unlock(&async->lock);
+
+  reader_touch(rd, id);
+
+  if (req != NULL)
+    *req = item;
+
+  return 0;
+}
+
+int ba_read_request_cancel(ba_read_request_t *req) {
+  if (req == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_async *async = req->rd->async;
+  ba_mutex_lock(&async->lock);
+  if (req->state != BA_READ_QUEUED) {
+    ba_mutex_unlock(&async->lock);
+    errno = EBUSY;
+    return -1;
+  }
+
+  async_remove(async, span_find(async, req->lo, req->seq));
+  req->err = ECANCELED;
+  async->canceled++;
+  ba_mutex_unlock(&async->lock);
+
+  if (req->cb != NULL)
+    req->cb(req->arg, req->id, req->err);
+
+  ba_mutex_lock(&async->lock);
+  req->state = BA_READ_DONE;
+  ba_cond_broadcast(&async->done);
+  ba_mutex_unlock(&async->lock);
+
+  return 0;
+}
+
+int ba_read_request_set_priority(ba_read_request_t *req, int32_t priority) {
+  if (req == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_async *async = req->rd->async;
+  ba_mutex_lock(&async->lock);
+  int queued = req->state == BA_READ_QUEUED;
+  if (queued) {
+    req->priority = priority;
+    heap_up(async, req->slot);
+    heap_down(async, req->slot);
+  }
+  ba_mutex_unlock(&async->lock);
+
+  if (!queued) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ba_reader_async_stats(ba_reader_t *rd, uint64_t *completed,
+                          uint64_t *canceled, uint64_t *late,
+                          uint64_t *merged) {
+  if (rd == NULL || completed == NULL || canceled == NULL || late == NULL ||
+      merged == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *completed = 0;
+  *canceled = 0;
+  *late = 0;
+  *merged = 0;
+
+  ba_mutex_lock(&rd->lock);
+  struct ba_async *async = rd->async;
+  ba_mutex_unlock(&rd->lock);
+  if (async == NULL)
+    return 0;
+
+  ba_mutex_lock(&async->lock);
+  *completed = async->completed;
+  *canceled = async->canceled;
+  *late = async->late;
+  *merged = async->merged;
+  ba_mutex_unlock(&async->lock);
+
+  return 0;
+}
+
+int ba_read_request_poll(ba_read_request_t *req) {
+  if (req == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_async *async = req->rd->async;
+  ba_mutex_lock(&async->lock);
+  int done = req->state == BA_READ_DONE;
+  ba_mutex_unlock(&async->lock);
+
+  return done;
+}
+
+int ba_read_request_wait(ba_read_request_t *req) {
+  if (req == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct ba_async *async = req->rd->async;
+  ba_mutex_lock(&async->lock);
+  while (req->state != BA_READ_DONE)
+    ba_cond_wait(&async->done, &async->lock);
+  int err = req->err;
+  ba_mutex_unlock(&async->lock);
+
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+void ba_read_request_free(ba_read_request_t **req) {
+  if (req == NULL || *req == NULL) {
+    errno = EINVAL;
+    return;
+  }
+
+  struct ba_async *async = (*req)->rd->async;
+  ba_mutex_lock(&async->lock);
+  while ((*req)->state != BA_READ_DONE)
+    ba_cond_wait(&async->done, &async->lock);
+  ba_mutex_unlock(&async->lock);
+
+  free(*req);
+
+  *req = NULL;
+}
+
+int ba_reader_set_cache(ba_reader_t *rd, uint64_t budget) {
+  if (rd == NULL || rd->ahdr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (rd->entries != NULL) {
+    ba_lru_set_budget(rd->entries, budget);
+    return 0;
+  }
+
+  if (budget == 0)
+    return 0;
+
+  struct ba_lru *entries = malloc(sizeof(*entries));
+  if (entries == NULL)
+    return -1;
+
+  if (ba_lru_init(entries, rd->ahdr->ensz, budget) < 0) {
+    free(entries);
+    return -1;
+  }
+
+  rd->entries = entries;
+
+  return 0;
+}
+
+int ba_reader_cache_stats(const ba_reader_t *rd, uint64_t *hits,
+                          uint64_t *misses, uint64_t *bytes) {
+  if (rd == NULL || hits == NULL || misses == NULL || bytes == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *hits = 0;
+  *misses = 0;
+  *bytes = 0;
+
+  if (rd->entries == NULL)
+    return 0;
+
+  ba_lru_stats(rd->entries, hits, misses, bytes);
+
+  return 0;
+}
+
+int ba_reader_read_cached(ba_reader_t *rd, ba_id_t id, const void **ptr) {
+  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reader_touch(rd, id);
+
+  struct ba_cache_item *item = NULL;
+  if (rd->entries != NULL)
+    item = ba_lru_get(rd->entries, id);
+
+  if (item == NULL) {
+    item = ba_cache_item_alloc(id, rd->ehdr[id].bosz);
+    if (item == NULL)
+      return -1;
+
+    if (reader_fill(rd, id, item->data) < 0) {
+      free(item);
+      return -1;
+    }
+
+    if (rd->entries != NULL)
+      item = ba_lru_put(rd->entries, item);
+  }
+
+  *ptr = item->data;
+
+  return 0;
+}
+
+void ba_reader_release_cached(ba_reader_t *rd, const void *ptr) {
+  if (rd == NULL || ptr == NULL) {
+    errno = EINVAL;
+    return;
+  }
+
+  struct ba_cache_item *item =
+      (struct ba_cache_item *)((const uint8_t *)ptr -
+                               offsetof(struct ba_cache_item, data));
+
+  if (rd->entries != NULL)
+    ba_lru_release(rd->entries, item);
+  else
+    free(item);
+}
+
+int ba_reader_read_range(ba_reader_t *rd, ba_id_t id, uint64_t offset,
+                         uint64_t len, void *ptr) {
+  if (rd == NULL || id >= rd->ahdr->ensz || ptr == NULL ||
+      offset > rd->ehdr[id].bosz || rd->ehdr[id].bosz - offset < len) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reader_touch(rd, id);
+
+  if (len == 0)
+    return 0;
+
+  const void *data = reader_warm(rd, id);
+  if (data != NULL) {
+    memcpy(ptr, (const uint8_t *)data + offset, len);
+    return 0;
+  }
+
+  struct ba_entry_stream st;
+  if (stream_init(&st, rd, id, offset) < 0)
+    return -1;
+
+  uint64_t size = stream_read(&st, ptr, len);
+  if (size == ~0ULL) {
+    stream_end(&st);
+    return -1;
+  }
+
+  stream_end(&st);
+
+  if (size != len) {
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ba_entry_stream_open(ba_reader_t *rd, ba_id_t id,
+                         ba_entry_stream_t **st) {
+  if (rd == NULL || id >= rd->ahdr->ensz || st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reader_touch(rd, id);
+
+  *st = malloc(sizeof(**st));
+  if (*st == NULL)
+    return -1;
+
+  if (stream_init(*st, rd, id, 0) < 0) {
+    free(*st);
+    *st = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+uint64_t ba_entry_stream_read(ba_entry_stream_t *st, void *ptr,
+                              uint64_t size) {
+  if (st == NULL || ptr == NULL) {
+    errno = EINVAL;
+    return ~0ULL;
+  }
+
+  return stream_read(st, ptr, size);
+}
+
+void ba_entry_stream_close(ba_entry_stream_t **st) {
+  if (st == NULL || *st == NULL) {
+    errno = EINVAL;
+    return;
+  }
+
+  stream_end(*st);
+
+  free(*st);
+  *st = NULL;
+}
+
+const struct ba_entry_header *ba_index_entries(const ba_reader_t *rd) {
+  return rd->ehdr;
+}
+
+const uint8_t *ba_index_dict(const ba_reader_t *rd, uint32_t *len) {
+  *len = rd->dict_len;
+  return rd->dict;
+}
+
+const struct ba_solid_block *ba_index_solid(const ba_reader_t *rd,
+                                            uint32_t *count) {
+  *count = rd->solid_count;
+  return rd->solid;
+}
+
+const struct ba_update_info *ba_index_update(const ba_reader_t *rd) {
+  return &rd->update;
+}
+
+const struct ba_source_info *ba_index_sources(const ba_reader_t *rd) {
+  return rd->sources;
+}
+
+uint64_t ba_index_size(const ba_reader_t *rd) { return rd->size; }
+
+int ba_index_pread(const ba_reader_t *rd, void *ptr, uint64_t size,
+                   uint64_t off) {
+  if (off > rd->size || rd->size - off < size) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (rd->base != NULL) {
+    memcpy(ptr, &rd->base[off], size);
+    return 0;
+  }
+
+  if (ba_buffer_pread(rd->buf, ptr, size, off) != size) {
+    errno = EIO;
+    return -1;
+  }
 
   return 0;
 }
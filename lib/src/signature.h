@@ -2,5 +2,6 @@
 #define BA_SIGNATURE_H
 
 #define BA_SIGNATURE (*(uint32_t *)"5314")
+#define BA_SIGNATURE_V2 (*(uint32_t *)"5315")
 
 #endif
@@ -0,0 +1,147 @@
+#ifndef BA_THREAD_H
+#define BA_THREAD_H
+
+#include <stdint.h>
+
+typedef void (*ba_thread_func)(void *arg);
+
+#ifdef _WIN32
+#include <Windows.h>
+
+typedef SRWLOCK ba_mutex_t;
+typedef CONDITION_VARIABLE ba_cond_t;
+
+typedef struct {
+  HANDLE handle;
+  ba_thread_func func;
+  void *arg;
+} ba_thread_t;
+
+#define BA_MUTEX_INIT SRWLOCK_INIT
+
+static inline int ba_mutex_init(ba_mutex_t *mtx) {
+  InitializeSRWLock(mtx);
+  return 0;
+}
+
+static inline void ba_mutex_destroy(ba_mutex_t *mtx) { (void)mtx; }
+
+static inline void ba_mutex_lock(ba_mutex_t *mtx) {
+  AcquireSRWLockExclusive(mtx);
+}
+
+static inline void ba_mutex_unlock(ba_mutex_t *mtx) {
+  ReleaseSRWLockExclusive(mtx);
+}
+
+static inline int ba_cond_init(ba_cond_t *cnd) {
+  InitializeConditionVariable(cnd);
+  return 0;
+}
+
+static inline void ba_cond_destroy(ba_cond_t *cnd) { (void)cnd; }
+
+static inline void ba_cond_wait(ba_cond_t *cnd, ba_mutex_t *mtx) {
+  SleepConditionVariableSRW(cnd, mtx, INFINITE, 0);
+}
+
+static inline void ba_cond_signal(ba_cond_t *cnd) {
+  WakeConditionVariable(cnd);
+}
+
+static inline void ba_cond_broadcast(ba_cond_t *cnd) {
+  WakeAllConditionVariable(cnd);
+}
+
+static inline DWORD WINAPI ba_thread_start(LPVOID arg) {
+  ba_thread_t *thr = arg;
+  thr->func(thr->arg);
+  return 0;
+}
+
+static inline int ba_thread_create(ba_thread_t *thr, ba_thread_func func,
+                                   void *arg) {
+  thr->func = func;
+  thr->arg = arg;
+  thr->handle = CreateThread(NULL, 0, ba_thread_start, thr, 0, NULL);
+  return thr->handle == NULL ? -1 : 0;
+}
+
+static inline void ba_thread_join(ba_thread_t *thr) {
+  WaitForSingleObject(thr->handle, INFINITE);
+  CloseHandle(thr->handle);
+}
+
+static inline uint64_t ba_time_ms(void) { return GetTickCount64(); }
+#else
+#include <pthread.h>
+#include <time.h>
+
+typedef pthread_mutex_t ba_mutex_t;
+typedef pthread_cond_t ba_cond_t;
+
+typedef struct {
+  pthread_t handle;
+  ba_thread_func func;
+  void *arg;
+} ba_thread_t;
+
+#define BA_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+
+static inline int ba_mutex_init(ba_mutex_t *mtx) {
+  return -(pthread_mutex_init(mtx, NULL) != 0);
+}
+
+static inline void ba_mutex_destroy(ba_mutex_t *mtx) {
+  pthread_mutex_destroy(mtx);
+}
+
+static inline void ba_mutex_lock(ba_mutex_t *mtx) { pthread_mutex_lock(mtx); }
+
+static inline void ba_mutex_unlock(ba_mutex_t *mtx) {
+  pthread_mutex_unlock(mtx);
+}
+
+static inline int ba_cond_init(ba_cond_t *cnd) {
+  return -(pthread_cond_init(cnd, NULL) != 0);
+}
+
+static inline void ba_cond_destroy(ba_cond_t *cnd) {
+  pthread_cond_destroy(cnd);
+}
+
+static inline void ba_cond_wait(ba_cond_t *cnd, ba_mutex_t *mtx) {
+  pthread_cond_wait(cnd, mtx);
+}
+
+static inline void ba_cond_signal(ba_cond_t *cnd) { pthread_cond_signal(cnd); }
+
+static inline void ba_cond_broadcast(ba_cond_t *cnd) {
+  pthread_cond_broadcast(cnd);
+}
+
+static inline void *ba_thread_start(void *arg) {
+  ba_thread_t *thr = arg;
+  thr->func(thr->arg);
+  return NULL;
+}
+
+static inline int ba_thread_create(ba_thread_t *thr, ba_thread_func func,
+                                   void *arg) {
+  thr->func = func;
+  thr->arg = arg;
+  return -(pthread_create(&thr->handle, NULL, ba_thread_start, thr) != 0);
+}
+
+static inline void ba_thread_join(ba_thread_t *thr) {
+  pthread_join(thr->handle, NULL);
+}
+
+static inline uint64_t ba_time_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif
+
+#endif
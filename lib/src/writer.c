@@ -1,23 +1,146 @@
+#include "codec.h"
+#include "dict.h"
+#include "hash.h"
 #include "headers.h"
+#include "index.h"
+#include "pipe.h"
 #include "signature.h"
+#include "thread.h"
+#include <ba/reader.h>
 #include <ba/writer.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <zlib.h>
 
+#ifdef _WIN32
+#include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <share.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 struct ba_entry_column {
   char *name;
   uint64_t nlen;
+  char *path;
   ba_buffer_t *buf;
+  int reuse;
+  struct ba_entry_header keep;
+  struct ba_source_info source;
+  int preload;
+};
+
+#define BA_REUSE_NONE 0
+#define BA_REUSE_REF 1
+#define BA_REUSE_COPY 2
+
+struct ba_solid_plan {
+  uint32_t *block_of;
+  uint64_t *offset_of;
+  uint32_t *first;
+  uint64_t *origin;
+  struct ba_solid_block *blocks;
+  uint32_t count;
 };
 
 struct ba_writer {
   uint32_t entry_size;
   uint32_t entry_cap;
   struct ba_entry_column *entries;
+  int hash_index;
+  uint64_t block_size;
+  uint32_t threads;
+  uint64_t buffer_size;
+  int trailing_index;
+  uint32_t codec;
+  int level;
+  uint32_t store_threshold;
+  int dedup;
+  uint32_t dict_size;
+  uint8_t *dict;
+  uint32_t dict_len;
+  uint64_t solid_size;
+  struct ba_solid_plan solid;
+  uint64_t append_at;
+  const ba_reader_t *source;
+  struct ba_update_info update;
+  char *previous;
+  int sources;
+  uint64_t alignment;
+  char *order;
+  char *preload;
+  uint32_t *layout;
+  struct ba_preload_info *regions;
+  uint32_t region_count;
+  uint32_t region_cap;
+};
+
+struct ba_write_job {
+  ba_buffer_t *out;
+  struct ba_entry_header ehdr;
+  int state;
+  int stream;
+  int err;
+};
+
+struct ba_write_pool {
+  ba_writer_t *wr;
+  const uint32_t *dupes;
+  struct ba_write_job *jobs;
+  ba_mutex_t lock;
+  ba_cond_t cond;
+  uint32_t next;
+  uint32_t limit;
+  int stop;
+};
+
+#define BA_WRITE_CHUNK 0x10000
+#define BA_WRITE_SCRATCH (2 * BA_WRITE_CHUNK)
+#define BA_WRITE_BUFFER 0x1000000
+#define BA_WRITE_SAMPLE 0x100000
+#define BA_WRITE_THRESHOLD 5
+#define BA_PRELOAD_GAP 0x1000
+
+#define BA_JOB_PENDING 0
+#define BA_JOB_DONE 1
+#define BA_JOB_FAILED 2
+#define BA_JOB_STREAM 3
+#define BA_JOB_DUPE 4
+#define BA_JOB_SOLID 5
+#define BA_JOB_BLOCK 6
+#define BA_JOB_KEPT 7
+
+struct ba_dedup_key {
+  uint64_t size;
+  uint32_t hash;
+  uint32_t id;
+};
+
+struct ba_shared_key {
+  uint64_t boff;
+  uint32_t id;
+};
+
+struct ba_payload_range {
+  uint64_t off;
+  uint64_t size;
+};
+
+struct ba_order_key {
+  const char *name;
+  uint64_t nlen;
+  uint32_t group;
+  uint32_t rank;
+  uint32_t id;
 };
 
 int ba_writer_alloc(ba_writer_t **wr) {
@@ -39,9 +162,25 @@ int ba_writer_alloc(ba_writer_t **wr) {
     return -1;
   }
 
+  (*wr)->hash_index = 1;
+  (*wr)->buffer_size = BA_WRITE_BUFFER;
+  (*wr)->codec = BA_CODEC_DEFLATE;
+  (*wr)->level = Z_DEFAULT_COMPRESSION;
+  (*wr)->store_threshold = BA_WRITE_THRESHOLD;
+  (*wr)->dedup = 1;
+
   return 0;
 }
 
+static void solid_clear(struct ba_solid_plan *plan) {
+  free(plan->block_of);
+  free(plan->offset_of);
+  free(plan->first);
+  free(plan->origin);
+  free(plan->blocks);
+  memset(plan, 0, sizeof(*plan));
+}
+
 void ba_writer_free(ba_writer_t **wr) {
   if (wr == NULL || *wr == NULL) {
     errno = EINVAL;
@@ -50,213 +189,2693 @@ void ba_writer_free(ba_writer_t **wr) {
 
   for (uint32_t i = 0; i < (*wr)->entry_size; i++) {
     free((*wr)->entries[i].name);
+    free((*wr)->entries[i].path);
     ba_buffer_free(&(*wr)->entries[i].buf);
   }
 
   free((*wr)->entries);
+  free((*wr)->dict);
+  free((*wr)->previous);
+  free((*wr)->order);
+  free((*wr)->preload);
+  free((*wr)->regions);
+  solid_clear(&(*wr)->solid);
 
   free(*wr);
   *wr = NULL;
 }
 
-int ba_writer_add(ba_writer_t *wr, const char *entry, uint64_t entry_len,
-                  ba_buffer_t *buf) {
-  if (wr == NULL || buf == NULL) {
+int ba_writer_set_hash_index(ba_writer_t *wr, int enable) {
+  if (wr == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  if (entry_len == 0)
-    entry_len = strlen(entry);
+  wr->hash_index = enable != 0;
 
-  if (wr->entry_size >= wr->entry_cap) {
-    uint32_t new_cap = wr->entry_cap << 1;
-    struct ba_entry_column *new_entries =
-        realloc(wr->entries, new_cap * sizeof(*wr->entries));
-    if (new_entries == NULL)
-      return -1;
-    wr->entries = new_entries;
-    wr->entry_cap = new_cap;
+  return 0;
+}
+
+int ba_writer_set_block_size(ba_writer_t *wr, uint64_t size) {
+  if (wr == NULL || size > UINT32_MAX) {
+    errno = EINVAL;
+    return -1;
   }
 
-  struct ba_entry_column col;
+  wr->block_size = size;
 
-  col.name = malloc(entry_len);
-  if (col.name == NULL)
+  return 0;
+}
+
+int ba_writer_set_threads(ba_writer_t *wr, uint32_t threads) {
+  if (wr == NULL) {
+    errno = EINVAL;
     return -1;
-  memcpy(col.name, entry, col.nlen = entry_len);
-  col.buf = buf;
+  }
 
-  wr->entries[wr->entry_size++] = col;
+  wr->threads = threads;
 
   return 0;
 }
 
-int ba_writer_add_file(ba_writer_t *wr, const char *filename) {
-  if (wr == NULL || filename == NULL) {
+int ba_writer_set_buffer_size(ba_writer_t *wr, uint64_t size) {
+  if (wr == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  ba_buffer_t *buf;
-  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+  wr->buffer_size = size;
+
+  return 0;
+}
+
+int ba_writer_set_trailing_index(ba_writer_t *wr, int enable) {
+  if (wr == NULL) {
+    errno = EINVAL;
     return -1;
+  }
 
-  if (ba_writer_add(wr, filename, 0, buf) < 0) {
-    ba_buffer_free(&buf);
+  wr->trailing_index = enable != 0;
+
+  return 0;
+}
+
+int ba_writer_set_codec(ba_writer_t *wr, uint32_t codec, int level) {
+  if (wr == NULL || (codec != BA_CODEC_DEFLATE && codec != BA_CODEC_STORE) ||
+      level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+    errno = EINVAL;
     return -1;
   }
 
+  wr->codec = codec;
+  wr->level = level;
+
   return 0;
 }
 
-int ba_writer_write(ba_writer_t *wr, ba_buffer_t *buf) {
-  if (wr == NULL || buf == NULL) {
+int ba_writer_set_store_threshold(ba_writer_t *wr, uint32_t percent) {
+  if (wr == NULL || percent > 100) {
     errno = EINVAL;
     return -1;
   }
 
-  if (ba_buffer_seek(buf,
-                     sizeof(struct ba_archive_header) +
-                         wr->entry_size * sizeof(struct ba_entry_header),
-                     SEEK_SET) < 0)
+  wr->store_threshold = percent;
+
+  return 0;
+}
+
+int ba_writer_set_dedup(ba_writer_t *wr, int enable) {
+  if (wr == NULL) {
+    errno = EINVAL;
     return -1;
+  }
 
-  struct ba_archive_header header = {0};
-  header.sign = BA_SIGNATURE;
-  header.ensz = wr->entry_size;
+  wr->dedup = enable != 0;
 
-  struct ba_entry_header *entry_headers =
-      calloc(wr->entry_size, sizeof(*entry_headers));
-  if (entry_headers == NULL)
+  return 0;
+}
+
+int ba_writer_set_dictionary_size(ba_writer_t *wr, uint32_t size) {
+  if (wr == NULL || size > BA_DICT_MAX) {
+    errno = EINVAL;
     return -1;
+  }
 
-  for (uint32_t i = 0; i < wr->entry_size; i++) {
-    if (ba_buffer_write(buf, wr->entries[i].name, wr->entries[i].nlen) < 0) {
-      free(entry_headers);
-      return -1;
-    }
+  wr->dict_size = size;
 
-    entry_headers[i].tidx = header.tbsz;
-    entry_headers[i].tlen = wr->entries[i].nlen;
+  return 0;
+}
 
-    header.tbsz += entry_headers[i].tlen;
+int ba_writer_set_solid_size(ba_writer_t *wr, uint64_t size) {
+  if (wr == NULL || size > UINT32_MAX) {
+    errno = EINVAL;
+    return -1;
   }
 
-  z_stream strm = {0};
+  wr->solid_size = size;
 
-  for (uint32_t i = 0; i < wr->entry_size; i++) {
-    int64_t size = ba_buffer_size(wr->entries[i].buf);
-    if (size == -1LL) {
-      free(entry_headers);
-      return -1;
-    }
+  return 0;
+}
 
-    if (ba_buffer_seek(wr->entries[i].buf, 0, SEEK_SET) < 0) {
-      free(entry_headers);
-      return -1;
-    }
-    void *data = malloc(size);
-    if (data == NULL) {
-      free(entry_headers);
-      return -1;
-    }
-    if (ba_buffer_read(wr->entries[i].buf, data, size) < size) {
-      free(data);
-      free(entry_headers);
-      return -1;
-    }
+static char *copy_string(const char *str) {
+  size_t len = strlen(str) + 1;
+  char *copy = malloc(len);
+  if (copy == NULL)
+    return NULL;
 
-    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
-      free(data);
-      free(entry_headers);
-      return -1;
-    }
+  memcpy(copy, str, len);
 
-    uint64_t size_in = size;
-    void *buffer_in = data;
-    uint64_t size_out = deflateBound(&strm, size_in);
-    void *buffer_out = malloc(size_out);
-    if (buffer_out == NULL) {
-      deflateEnd(&strm);
-      free(data);
-      free(entry_headers);
-      return -1;
-    }
+  return copy;
+}
 
-    strm.next_in = buffer_in;
-    strm.avail_in = size_in;
-    strm.next_out = buffer_out;
-    strm.avail_out = size_out;
+int ba_writer_set_previous_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-    do {
-      int ret = deflate(&strm, Z_FINISH);
-      if (ret == Z_STREAM_END)
-        break;
-      else if (ret != Z_OK) {
-        errno = EIO;
-        deflateEnd(&strm);
-        free(buffer_out);
-        free(data);
-        free(entry_headers);
-        return -1;
-      }
-    } while (1);
+  char *previous = NULL;
+  if (filename != NULL && (previous = copy_string(filename)) == NULL)
+    return -1;
 
-    entry_headers[i].boff = ba_buffer_tell(buf);
-    entry_headers[i].bosz = strm.total_in;
-    entry_headers[i].bcsz = strm.total_out;
+  free(wr->previous);
+  wr->previous = previous;
 
-    if (ba_buffer_write(buf, buffer_out, entry_headers[i].bcsz) < 0) {
-      deflateEnd(&strm);
-      free(buffer_out);
-      free(data);
-      free(entry_headers);
-      return -1;
-    }
+  return 0;
+}
 
-    deflateEnd(&strm);
-    free(buffer_out);
-    free(data);
+int ba_writer_set_order_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  if (ba_buffer_seek(buf, 0, SEEK_SET) < 0) {
-    free(entry_headers);
+  char *order = NULL;
+  if (filename != NULL && (order = copy_string(filename)) == NULL)
+    return -1;
+
+  free(wr->order);
+  wr->order = order;
+
+  return 0;
+}
+
+int ba_writer_set_preload_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL) {
+    errno = EINVAL;
     return -1;
   }
 
-  if (ba_buffer_write(buf, &header, sizeof(header)) < 0) {
-    free(entry_headers);
+  char *preload = NULL;
+  if (filename != NULL && (preload = copy_string(filename)) == NULL)
+    return -1;
+
+  free(wr->preload);
+  wr->preload = preload;
+
+  return 0;
+}
+
+int ba_writer_set_alignment(ba_writer_t *wr, uint64_t alignment) {
+  if (wr == NULL || alignment > UINT32_MAX) {
+    errno = EINVAL;
     return -1;
   }
 
-  if (ba_buffer_write(buf, entry_headers,
-                      wr->entry_size * sizeof(*entry_headers)) < 0) {
-    free(entry_headers);
+  wr->alignment = alignment;
+
+  return 0;
+}
+
+static int add_column(ba_writer_t *wr, const char *entry, uint64_t entry_len,
+                      ba_buffer_t *buf, const char *path) {
+  if (entry_len == 0)
+    entry_len = strlen(entry);
+
+  if (wr->entry_size >= wr->entry_cap) {
+    uint32_t new_cap = wr->entry_cap << 1;
+    struct ba_entry_column *new_entries =
+        realloc(wr->entries, new_cap * sizeof(*wr->entries));
+    if (new_entries == NULL)
+      return -1;
+    wr->entries = new_entries;
+    wr->entry_cap = new_cap;
+  }
+
+  struct ba_entry_column col;
+
+  col.name = malloc(entry_len);
+  if (col.name == NULL)
+    return -1;
+  memcpy(col.name, entry, col.nlen = entry_len);
+
+  col.path = NULL;
+  if (path != NULL && (col.path = copy_string(path)) == NULL) {
+    free(col.name);
     return -1;
   }
 
-  free(entry_headers);
+  col.buf = buf;
+  col.reuse = BA_REUSE_NONE;
+  memset(&col.keep, 0, sizeof(col.keep));
+  memset(&col.source, 0, sizeof(col.source));
+  col.preload = 0;
+  if (buf != NULL)
+    col.source.size = ba_buffer_size(buf);
+
+  wr->entries[wr->entry_size++] = col;
 
   return 0;
 }
 
-int ba_writer_write_file(ba_writer_t *wr, const char *filename) {
+int ba_writer_add(ba_writer_t *wr, const char *entry, uint64_t entry_len,
+                  ba_buffer_t *buf) {
+  if (wr == NULL || buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return add_column(wr, entry, entry_len, buf, NULL);
+}
+
+int ba_writer_add_file(ba_writer_t *wr, const char *filename) {
   if (wr == NULL || filename == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  ba_buffer_t *buf;
-  if (ba_buffer_init_file(&buf, filename, "wb") < 0)
+  struct stat st;
+  if (stat(filename, &st) < 0)
     return -1;
 
-  if (ba_writer_write(wr, buf) < 0) {
-    ba_buffer_free(&buf);
+  if ((st.st_mode & S_IFMT) != S_IFREG) {
+    errno = EINVAL;
     return -1;
   }
 
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
   ba_buffer_free(&buf);
 
+  if (add_column(wr, filename, 0, NULL, filename) < 0)
+    return -1;
+
+  struct ba_entry_column *col = &wr->entries[wr->entry_size - 1];
+  col->source.size = st.st_size;
+  col->source.mtim = st.st_mtime;
+
+  return 0;
+}
+
+static int column_open(struct ba_entry_column *col) {
+  if (col->buf != NULL)
+    return 0;
+
+  if (ba_buffer_init_file(&col->buf, col->path, "rb") < 0)
+    return -1;
+
+  if (ba_buffer_size(col->buf) != col->source.size) {
+    ba_buffer_free(&col->buf);
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void column_close(struct ba_entry_column *col) {
+  if (col->path != NULL)
+    ba_buffer_free(&col->buf);
+}
+
+static uint64_t column_size(const struct ba_entry_column *col) {
+  if (col->path != NULL)
+    return col->source.size;
+
+  return ba_buffer_size(col->buf);
+}
+
+static int write_padding(ba_buffer_t *buf, uint64_t size) {
+  static const uint8_t zeros[64] = {0};
+
+  while (size > 0) {
+    uint64_t n = size > sizeof(zeros) ? sizeof(zeros) : size;
+    if (ba_buffer_write(buf, zeros, n) < 0)
+      return -1;
+    size -= n;
+  }
+
+  return 0;
+}
+
+static int write_names(ba_writer_t *wr, ba_buffer_t *buf) {
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    if (ba_buffer_write(buf, wr->entries[i].name, wr->entries[i].nlen) < 0)
+      return -1;
+
+  return 0;
+}
+
+static int write_hash_index(ba_writer_t *wr, ba_buffer_t *buf) {
+  uint32_t cap = ba_hash_capacity(wr->entry_size);
+  struct ba_hash_slot *slots = malloc(cap * sizeof(*slots));
+  if (slots == NULL)
+    return -1;
+  memset(slots, 0xff, cap * sizeof(*slots));
+
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    ba_hash_insert(slots, cap,
+                   ba_hash(wr->entries[i].name, wr->entries[i].nlen), i);
+
+  if (ba_buffer_write(buf, slots, cap * sizeof(*slots)) < 0) {
+    free(slots);
+    return -1;
+  }
+
+  free(slots);
+
   return 0;
 }
+
+static uint64_t plan_sections(ba_writer_t *wr,
+                              struct ba_section_header *sections,
+                              uint32_t sccn, uint64_t off) {
+  for (uint32_t i = 0; i < sccn; i++) {
+    sections[i].soff = (off + 7) & ~(uint64_t)7;
+
+    if (sections[i].type == BA_SECTION_HASH)
+      sections[i].ssiz =
+          ba_hash_capacity(wr->entry_size) * sizeof(struct ba_hash_slot);
+    else if (sections[i].type == BA_SECTION_DICT)
+      sections[i].ssiz = wr->dict_len;
+    else if (sections[i].type == BA_SECTION_SOLID)
+      sections[i].ssiz = wr->solid.count * sizeof(struct ba_solid_block);
+    else if (sections[i].type == BA_SECTION_UPDATE)
+      sections[i].ssiz = sizeof(wr->update);
+    else if (sections[i].type == BA_SECTION_SOURCE)
+      sections[i].ssiz = wr->entry_size * sizeof(struct ba_source_info);
+    else if (sections[i].type == BA_SECTION_PRELOAD)
+      sections[i].ssiz = wr->region_count * sizeof(*wr->regions);
+
+    off = sections[i].soff + sections[i].ssiz;
+  }
+
+  return off;
+}
+
+static int write_sections(ba_writer_t *wr, ba_buffer_t *buf,
+                          const struct ba_section_header *sections,
+                          uint32_t sccn, uint64_t off) {
+  for (uint32_t i = 0; i < sccn; i++) {
+    if (write_padding(buf, sections[i].soff - off) < 0)
+      return -1;
+
+    if (sections[i].type == BA_SECTION_HASH) {
+      if (write_hash_index(wr, buf) < 0)
+        return -1;
+    } else if (sections[i].type == BA_SECTION_DICT) {
+      if (ba_buffer_write(buf, wr->dict, wr->dict_len) < 0)
+        return -1;
+    } else if (sections[i].type == BA_SECTION_SOLID) {
+      if (ba_buffer_write(buf, wr->solid.blocks, sections[i].ssiz) < 0)
+        return -1;
+    } else if (sections[i].type == BA_SECTION_UPDATE) {
+      if (ba_buffer_write(buf, &wr->update, sections[i].ssiz) < 0)
+        return -1;
+    } else if (sections[i].type == BA_SECTION_PRELOAD) {
+      if (ba_buffer_write(buf, wr->regions, sections[i].ssiz) < 0)
+        return -1;
+    } else if (sections[i].type == BA_SECTION_SOURCE) {
+      for (uint32_t j = 0; j < wr->entry_size; j++)
+        if (ba_buffer_write(buf, &wr->entries[j].source,
+                            sizeof(wr->entries[j].source)) < 0)
+          return -1;
+    }
+
+    off = sections[i].soff + sections[i].ssiz;
+  }
+
+  return 0;
+}
+
+static int write_headers(ba_writer_t *wr, ba_buffer_t *buf,
+                         const struct ba_archive_header *header,
+                         const struct ba_archive_extension *extension,
+                         const struct ba_section_header *sections,
+                         const struct ba_entry_header *entry_headers) {
+  if (ba_buffer_write(buf, header, sizeof(*header)) < 0)
+    return -1;
+
+  if (ba_buffer_write(buf, extension, sizeof(*extension)) < 0)
+    return -1;
+
+  if (ba_buffer_write(buf, sections, extension->sccn * sizeof(*sections)) < 0)
+    return -1;
+
+  if (ba_buffer_write(buf, entry_headers,
+                      wr->entry_size * sizeof(*entry_headers)) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int align_payload(const ba_writer_t *wr, ba_buffer_t *buf,
+                         uint64_t size, uint64_t *off) {
+  if (wr->alignment <= 1 || size == 0)
+    return 0;
+
+  uint64_t pad = (wr->alignment - *off % wr->alignment) % wr->alignment;
+  if (write_padding(buf, pad) < 0)
+    return -1;
+  *off += pad;
+
+  return 0;
+}
+
+static int deflate_to(const ba_writer_t *wr, ba_buffer_t *buf, uint8_t *chunk,
+                      ba_buffer_t *src, uint64_t size, uint64_t *out_size) {
+  z_stream *strm = ba_deflater_acquire(wr->level);
+  if (strm == NULL)
+    return -1;
+
+  if (wr->dict_len != 0 &&
+      deflateSetDictionary(strm, wr->dict, wr->dict_len) != Z_OK) {
+    errno = EIO;
+    ba_deflater_release(strm);
+    return -1;
+  }
+
+  uint8_t *in = chunk;
+  uint8_t *out = &chunk[BA_WRITE_CHUNK];
+  uint64_t left = size;
+  int ret;
+
+  *out_size = 0;
+
+  do {
+    if (strm->avail_in == 0 && left > 0) {
+      uint64_t n = left > BA_WRITE_CHUNK ? BA_WRITE_CHUNK : left;
+      if (ba_buffer_read(src, in, n) != n) {
+        errno = EIO;
+        ba_deflater_release(strm);
+        return -1;
+      }
+      strm->next_in = in;
+      strm->avail_in = n;
+      left -= n;
+    }
+
+    strm->next_out = out;
+    strm->avail_out = BA_WRITE_CHUNK;
+
+    ret = deflate(strm, left == 0 ? Z_FINISH : Z_NO_FLUSH);
+    if (ret == Z_STREAM_ERROR) {
+      errno = EIO;
+      ba_deflater_release(strm);
+      return -1;
+    }
+
+    uint64_t have = BA_WRITE_CHUNK - strm->avail_out;
+    if (ba_buffer_write(buf, out, have) < 0) {
+      ba_deflater_release(strm);
+      return -1;
+    }
+    *out_size += have;
+  } while (ret != Z_STREAM_END);
+
+  ba_deflater_release(strm);
+
+  return 0;
+}
+
+static int deflate_blocks_to(const ba_writer_t *wr, ba_buffer_t *buf,
+                             uint8_t *chunk, ba_buffer_t *src, uint64_t size,
+                             uint64_t *out_size) {
+  uint64_t block_size = wr->block_size;
+  uint64_t blocks = (size + block_size - 1) / block_size;
+  uint64_t *table = malloc((blocks + 1) * sizeof(*table));
+  if (table == NULL)
+    return -1;
+
+  uint64_t off = 0;
+  for (uint64_t i = 0; i < blocks; i++) {
+    uint64_t len = size - i * block_size;
+    if (len > block_size)
+      len = block_size;
+
+    uint64_t n;
+    if (deflate_to(wr, buf, chunk, src, len, &n) < 0) {
+      free(table);
+      return -1;
+    }
+
+    table[i] = off;
+    off += n;
+  }
+  table[blocks] = off;
+
+  if (ba_buffer_write(buf, table, (blocks + 1) * sizeof(*table)) < 0) {
+    free(table);
+    return -1;
+  }
+
+  free(table);
+
+  *out_size = off + (blocks + 1) * sizeof(*table);
+
+  return 0;
+}
+
+static int copy_buffer(ba_buffer_t *dst, ba_buffer_t *src, uint8_t *chunk) {
+  if (ba_buffer_seek(src, 0, SEEK_SET) < 0)
+    return -1;
+
+  uint64_t n;
+  while ((n = ba_buffer_read(src, chunk, BA_WRITE_CHUNK)) != 0) {
+    if (n == ~0ULL)
+      return -1;
+
+    if (ba_buffer_write(dst, chunk, n) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int store_to(ba_buffer_t *buf, uint8_t *chunk, ba_buffer_t *src,
+                    uint64_t size) {
+  while (size > 0) {
+    uint64_t n = size > BA_WRITE_CHUNK ? BA_WRITE_CHUNK : size;
+    if (ba_buffer_read(src, chunk, n) != n) {
+      errno = EIO;
+      return -1;
+    }
+
+    if (ba_buffer_write(buf, chunk, n) < 0)
+      return -1;
+
+    size -= n;
+  }
+
+  return 0;
+}
+
+static int compress_to(ba_writer_t *wr, ba_buffer_t *buf, uint8_t *chunk,
+                       ba_buffer_t *src, uint64_t size,
+                       struct ba_entry_header *ehdr) {
+  ehdr->codc = BA_ENTRY_DEFLATE;
+
+  if (wr->dict_len != 0)
+    ehdr->flag |= BA_ENTRY_DICT;
+
+  if (wr->block_size != 0 && size > wr->block_size) {
+    ehdr->flag |= BA_ENTRY_BLOCKS;
+    ehdr->bksz = wr->block_size;
+
+    return deflate_blocks_to(wr, buf, chunk, src, size, &ehdr->bcsz);
+  }
+
+  return deflate_to(wr, buf, chunk, src, size, &ehdr->bcsz);
+}
+
+static int worth_compressing(const ba_writer_t *wr, uint64_t size,
+                             uint64_t csize) {
+  if (wr->store_threshold == 0)
+    return 1;
+
+  return csize < size && (size - csize) * 100 >= size * wr->store_threshold;
+}
+
+static void store_header(struct ba_entry_header *ehdr) {
+  ehdr->flag = 0;
+  ehdr->codc = BA_ENTRY_STORE;
+  ehdr->bksz = 0;
+  ehdr->bcsz = ehdr->bosz;
+}
+
+static int encode_entry(ba_writer_t *wr, uint32_t i, uint8_t *chunk,
+                        ba_buffer_t **out, struct ba_entry_header *ehdr) {
+  ba_buffer_t *src = wr->entries[i].buf;
+  uint64_t size = column_size(&wr->entries[i]);
+
+  *out = NULL;
+  ehdr->bosz = size;
+
+  if (wr->codec == BA_CODEC_STORE) {
+    store_header(ehdr);
+    return 0;
+  }
+
+  if (ba_buffer_seek(src, 0, SEEK_SET) < 0)
+    return -1;
+
+  if (ba_buffer_init(out) < 0)
+    return -1;
+
+  if (compress_to(wr, *out, chunk, src, size, ehdr) < 0) {
+    ba_buffer_free(out);
+    return -1;
+  }
+
+  if (!worth_compressing(wr, size, ehdr->bcsz)) {
+    ba_buffer_free(out);
+    store_header(ehdr);
+  }
+
+  return 0;
+}
+
+static int sample_entry(ba_writer_t *wr, uint8_t *chunk, ba_buffer_t *src,
+                        uint64_t size, int *store) {
+  uint64_t n = size > BA_WRITE_SAMPLE ? BA_WRITE_SAMPLE : size;
+
+  ba_buffer_t *sink;
+  if (ba_buffer_init(&sink) < 0)
+    return -1;
+
+  uint64_t csize;
+  if (deflate_to(wr, sink, chunk, src, n, &csize) < 0) {
+    ba_buffer_free(&sink);
+    return -1;
+  }
+
+  ba_buffer_free(&sink);
+
+  *store = !worth_compressing(wr, n, csize);
+
+  return ba_buffer_seek(src, 0, SEEK_SET);
+}
+
+static int write_source(ba_writer_t *wr, uint32_t i, ba_buffer_t *buf,
+                        uint8_t *chunk, uint64_t off,
+                        struct ba_entry_header *ehdr) {
+  ba_buffer_t *src = wr->entries[i].buf;
+  uint64_t size = column_size(&wr->entries[i]);
+
+  ehdr->boff = off;
+
+  if (size <= wr->buffer_size) {
+    ba_buffer_t *out;
+    if (encode_entry(wr, i, chunk, &out, ehdr) < 0)
+      return -1;
+
+    if (out == NULL) {
+      if (ba_buffer_seek(src, 0, SEEK_SET) < 0)
+        return -1;
+
+      return store_to(buf, chunk, src, size);
+    }
+
+    int ret = copy_buffer(buf, out, chunk);
+    ba_buffer_free(&out);
+
+    return ret;
+  }
+
+  if (ba_buffer_seek(src, 0, SEEK_SET) < 0)
+    return -1;
+
+  ehdr->bosz = size;
+
+  int store = wr->codec == BA_CODEC_STORE;
+  if (!store && sample_entry(wr, chunk, src, size, &store) < 0)
+    return -1;
+
+  if (store) {
+    store_header(ehdr);
+    return store_to(buf, chunk, src, size);
+  }
+
+  return compress_to(wr, buf, chunk, src, size, ehdr);
+}
+
+static int write_entry(ba_writer_t *wr, uint32_t i, ba_buffer_t *buf,
+                       uint8_t *chunk, uint64_t off,
+                       struct ba_entry_header *ehdr) {
+  if (column_open(&wr->entries[i]) < 0)
+    return -1;
+
+  int ret = write_source(wr, i, buf, chunk, off, ehdr);
+  column_close(&wr->entries[i]);
+
+  return ret;
+}
+
+static int dedup_compare(const void *lhs, const void *rhs) {
+  const struct ba_dedup_key *a = lhs;
+  const struct ba_dedup_key *b = rhs;
+
+  if (a->size != b->size)
+    return a->size < b->size ? -1 : 1;
+  if (a->hash != b->hash)
+    return a->hash < b->hash ? -1 : 1;
+  if (a->id != b->id)
+    return a->id < b->id ? -1 : 1;
+  return 0;
+}
+
+static int hash_content(struct ba_entry_column *col, uint8_t *chunk,
+                        uint64_t size, uint32_t *hash) {
+  if (column_open(col) < 0)
+    return -1;
+
+  if (ba_buffer_seek(col->buf, 0, SEEK_SET) < 0) {
+    column_close(col);
+    return -1;
+  }
+
+  uLong crc = crc32(0, Z_NULL, 0);
+  while (size > 0) {
+    uint64_t n = size > BA_WRITE_CHUNK ? BA_WRITE_CHUNK : size;
+    if (ba_buffer_read(col->buf, chunk, n) != n) {
+      column_close(col);
+      errno = EIO;
+      return -1;
+    }
+
+    crc = crc32(crc, chunk, n);
+    size -= n;
+  }
+
+  column_close(col);
+  *hash = crc;
+
+  return 0;
+}
+
+static int compare_content(ba_buffer_t *a, ba_buffer_t *b, uint8_t *chunk,
+                           uint64_t size, int *same) {
+  if (ba_buffer_seek(a, 0, SEEK_SET) < 0 || ba_buffer_seek(b, 0, SEEK_SET) < 0)
+    return -1;
+
+  *same = 1;
+  while (size > 0 && *same) {
+    uint64_t n = size > BA_WRITE_CHUNK ? BA_WRITE_CHUNK : size;
+    if (ba_buffer_read(a, chunk, n) != n ||
+        ba_buffer_read(b, &chunk[BA_WRITE_CHUNK], n) != n) {
+      errno = EIO;
+      return -1;
+    }
+
+    *same = memcmp(chunk, &chunk[BA_WRITE_CHUNK], n) == 0;
+    size -= n;
+  }
+
+  return 0;
+}
+
+static int same_content(struct ba_entry_column *a, struct ba_entry_column *b,
+                        uint8_t *chunk, uint64_t size, int *same) {
+  if (column_open(a) < 0)
+    return -1;
+
+  if (column_open(b) < 0) {
+    column_close(a);
+    return -1;
+  }
+
+  int ret = compare_content(a->buf, b->buf, chunk, size, same);
+  column_close(b);
+  column_close(a);
+
+  return ret;
+}
+
+static int shared_compare(const void *lhs, const void *rhs) {
+  const struct ba_shared_key *a = lhs;
+  const struct ba_shared_key *b = rhs;
+
+  if (a->boff != b->boff)
+    return a->boff < b->boff ? -1 : 1;
+  if (a->id != b->id)
+    return a->id < b->id ? -1 : 1;
+  return 0;
+}
+
+static int find_shared(ba_writer_t *wr, uint32_t *dupes) {
+  if (wr->source == NULL)
+    return 0;
+
+  struct ba_shared_key *keys = calloc(wr->entry_size, sizeof(*keys));
+  if (keys == NULL)
+    return -1;
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    const struct ba_entry_column *col = &wr->entries[i];
+    if (col->reuse != BA_REUSE_COPY || col->keep.codc == BA_ENTRY_SOLID ||
+        col->keep.bcsz == 0)
+      continue;
+
+    keys[count].boff = col->keep.boff;
+    keys[count].id = i;
+    count++;
+  }
+  qsort(keys, count, sizeof(*keys), shared_compare);
+
+  for (uint32_t i = 1; i < count; i++)
+    if (keys[i].boff == keys[i - 1].boff)
+      dupes[keys[i].id] = dupes[keys[i - 1].id] != BA_ENTRY_INVALID
+                              ? dupes[keys[i - 1].id]
+                              : keys[i - 1].id;
+
+  free(keys);
+
+  return 0;
+}
+
+static int find_duplicates(ba_writer_t *wr, uint8_t *chunk, uint32_t *dupes) {
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    dupes[i] = BA_ENTRY_INVALID;
+
+  if (find_shared(wr, dupes) < 0)
+    return -1;
+
+  if (!wr->dedup || wr->entry_size < 2)
+    return 0;
+
+  struct ba_dedup_key *keys = calloc(wr->entry_size, sizeof(*keys));
+  if (keys == NULL)
+    return -1;
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    if (wr->entries[i].reuse == BA_REUSE_NONE)
+      keys[i].size = column_size(&wr->entries[i]);
+    keys[i].id = i;
+  }
+  qsort(keys, wr->entry_size, sizeof(*keys), dedup_compare);
+
+  for (uint32_t lo = 0, hi; lo < wr->entry_size; lo = hi) {
+    for (hi = lo + 1; hi < wr->entry_size && keys[hi].size == keys[lo].size;)
+      hi++;
+
+    if (hi - lo < 2 || keys[lo].size == 0)
+      continue;
+
+    for (uint32_t i = lo; i < hi; i++) {
+      if (hash_content(&wr->entries[keys[i].id], chunk, keys[i].size,
+                       &keys[i].hash) < 0) {
+        free(keys);
+        return -1;
+      }
+    }
+    qsort(&keys[lo], hi - lo, sizeof(*keys), dedup_compare);
+
+    for (uint32_t i = lo + 1; i < hi; i++) {
+      for (uint32_t j = i; j-- > lo && keys[j].hash == keys[i].hash;) {
+        int same;
+        if (same_content(&wr->entries[keys[j].id], &wr->entries[keys[i].id],
+                         chunk, keys[i].size, &same) < 0) {
+          free(keys);
+          return -1;
+        }
+
+        if (same) {
+          dupes[keys[i].id] = dupes[keys[j].id] != BA_ENTRY_INVALID
+                                  ? dupes[keys[j].id]
+                                  : keys[j].id;
+          break;
+        }
+      }
+    }
+  }
+
+  free(keys);
+
+  return 0;
+}
+
+static int train_dictionary(ba_writer_t *wr, const uint32_t *dupes) {
+  free(wr->dict);
+  wr->dict = NULL;
+  wr->dict_len = 0;
+
+  if (wr->dict_size == 0 || wr->codec == BA_CODEC_STORE ||
+      wr->entry_size == 0)
+    return 0;
+
+  uint64_t budget = (uint64_t)wr->dict_size * BA_DICT_SAMPLE_RATIO;
+  uint8_t *samples = malloc(budget);
+  if (samples == NULL)
+    return -1;
+
+  uint64_t *ends = malloc(wr->entry_size * sizeof(*ends));
+  if (ends == NULL) {
+    free(samples);
+    return -1;
+  }
+
+  uint64_t total = 0;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < wr->entry_size && total < budget; i++) {
+    if (dupes[i] != BA_ENTRY_INVALID || wr->entries[i].reuse != BA_REUSE_NONE)
+      continue;
+
+    struct ba_entry_column *col = &wr->entries[i];
+    uint64_t n = column_size(col);
+    if (n > BA_DICT_SAMPLE_ENTRY)
+      n = BA_DICT_SAMPLE_ENTRY;
+    if (n > budget - total)
+      n = budget - total;
+
+    if (column_open(col) < 0) {
+      free(ends);
+      free(samples);
+      return -1;
+    }
+
+    if (ba_buffer_seek(col->buf, 0, SEEK_SET) < 0 ||
+        ba_buffer_read(col->buf, &samples[total], n) != n) {
+      column_close(col);
+      free(ends);
+      free(samples);
+      errno = EIO;
+      return -1;
+    }
+    column_close(col);
+
+    total += n;
+    ends[count++] = total;
+  }
+
+  wr->dict = malloc(wr->dict_size);
+  if (wr->dict == NULL) {
+    free(ends);
+    free(samples);
+    return -1;
+  }
+
+  if (ba_dict_train(samples, ends, count, wr->dict, wr->dict_size,
+                    &wr->dict_len) < 0) {
+    free(wr->dict);
+    wr->dict = NULL;
+    free(ends);
+    free(samples);
+    return -1;
+  }
+
+  free(ends);
+  free(samples);
+
+  if (wr->dict_len == 0) {
+    free(wr->dict);
+    wr->dict = NULL;
+  }
+
+  return 0;
+}
+
+static uint32_t layout_at(const ba_writer_t *wr, uint32_t pos) {
+  return wr->layout != NULL ? wr->layout[pos] : pos;
+}
+
+static int plan_solid(ba_writer_t *wr, const uint32_t *dupes) {
+  struct ba_solid_plan *plan = &wr->solid;
+  uint32_t kept = plan->count;
+
+  if (wr->solid_size == 0 || wr->codec == BA_CODEC_STORE ||
+      wr->entry_size == 0)
+    return 0;
+
+  struct ba_solid_block *blocks =
+      realloc(plan->blocks, (kept + wr->entry_size) * sizeof(*blocks));
+  if (blocks == NULL) {
+    solid_clear(plan);
+    return -1;
+  }
+  memset(&blocks[kept], 0, wr->entry_size * sizeof(*blocks));
+  plan->blocks = blocks;
+
+  plan->block_of = malloc(wr->entry_size * sizeof(*plan->block_of));
+  plan->offset_of = malloc(wr->entry_size * sizeof(*plan->offset_of));
+  plan->first = malloc((kept + wr->entry_size) * sizeof(*plan->first));
+  if (plan->block_of == NULL || plan->offset_of == NULL ||
+      plan->first == NULL) {
+    solid_clear(plan);
+    return -1;
+  }
+
+  uint64_t limit = wr->solid_size / 4;
+
+  for (uint32_t pos = 0; pos < wr->entry_size; pos++) {
+    uint32_t i = layout_at(wr, pos);
+    plan->block_of[i] = BA_ENTRY_INVALID;
+
+    if (dupes[i] != BA_ENTRY_INVALID || wr->entries[i].reuse != BA_REUSE_NONE)
+      continue;
+
+    uint64_t size = column_size(&wr->entries[i]);
+    if (size == 0 || size > limit)
+      continue;
+
+    if (plan->count == kept ||
+        plan->blocks[plan->count - 1].bosz + size > wr->solid_size ||
+        wr->entries[layout_at(wr, plan->first[plan->count - 1])].preload !=
+            wr->entries[i].preload) {
+      plan->first[plan->count] = pos;
+      plan->blocks[plan->count].codc = BA_ENTRY_DEFLATE;
+      plan->count++;
+    }
+
+    struct ba_solid_block *block = &plan->blocks[plan->count - 1];
+    plan->block_of[i] = plan->count - 1;
+    plan->offset_of[i] = block->bosz;
+    block->bosz += size;
+  }
+
+  if (plan->count == 0)
+    solid_clear(plan);
+
+  return 0;
+}
+
+static int in_solid(const ba_writer_t *wr, uint32_t i) {
+  return wr->solid.block_of != NULL &&
+         wr->solid.block_of[i] != BA_ENTRY_INVALID;
+}
+
+static int encode_solid(ba_writer_t *wr, uint32_t b, uint8_t *chunk,
+                        ba_buffer_t **out, struct ba_entry_header *ehdr) {
+  const struct ba_solid_plan *plan = &wr->solid;
+
+  ba_buffer_t *data;
+  if (ba_buffer_init(&data) < 0)
+    return -1;
+
+  if (ba_buffer_reserve(data, plan->blocks[b].bosz) < 0) {
+    ba_buffer_free(&data);
+    return -1;
+  }
+
+  uint64_t left = plan->blocks[b].bosz;
+  for (uint32_t pos = plan->first[b]; left > 0; pos++) {
+    uint32_t i = layout_at(wr, pos);
+    if (plan->block_of[i] != b)
+      continue;
+
+    struct ba_entry_column *col = &wr->entries[i];
+    uint64_t size = column_size(col);
+    if (column_open(col) < 0) {
+      ba_buffer_free(&data);
+      return -1;
+    }
+
+    if (ba_buffer_seek(col->buf, 0, SEEK_SET) < 0 ||
+        store_to(data, chunk, col->buf, size) < 0) {
+      column_close(col);
+      ba_buffer_free(&data);
+      return -1;
+    }
+    column_close(col);
+    left -= size;
+  }
+
+  if (ba_buffer_seek(data, 0, SEEK_SET) < 0 || ba_buffer_init(out) < 0) {
+    ba_buffer_free(&data);
+    return -1;
+  }
+
+  ehdr->flag = wr->dict_len != 0 ? BA_ENTRY_DICT : 0;
+  ehdr->codc = BA_ENTRY_DEFLATE;
+
+  if (deflate_to(wr, *out, chunk, data, plan->blocks[b].bosz, &ehdr->bcsz) <
+      0) {
+    ba_buffer_free(out);
+    ba_buffer_free(&data);
+    return -1;
+  }
+
+  ba_buffer_free(&data);
+
+  return 0;
+}
+
+static int write_solid(ba_writer_t *wr, uint32_t b, ba_buffer_t *buf,
+                       ba_buffer_t *out, uint8_t *chunk,
+                       const struct ba_entry_header *ehdr, uint64_t *off) {
+  struct ba_solid_block *block = &wr->solid.blocks[b];
+
+  if (align_payload(wr, buf, ehdr->bcsz, off) < 0)
+    return -1;
+
+  block->boff = *off;
+  block->bcsz = ehdr->bcsz;
+  block->flag = ehdr->flag;
+  block->codc = ehdr->codc;
+
+  if (copy_buffer(buf, out, chunk) < 0)
+    return -1;
+  *off += block->bcsz;
+
+  return 0;
+}
+
+static void share_payload(struct ba_entry_header *dst,
+                          const struct ba_entry_header *src) {
+  dst->boff = src->boff;
+  dst->bcsz = src->bcsz;
+  dst->bosz = src->bosz;
+  dst->flag = src->flag;
+  dst->codc = src->codc;
+  dst->bksz = src->bksz;
+}
+
+static int copy_raw(const ba_reader_t *rd, ba_buffer_t *buf, uint8_t *chunk,
+                    uint64_t off, uint64_t size) {
+  while (size > 0) {
+    uint64_t n = size > BA_WRITE_SCRATCH ? BA_WRITE_SCRATCH : size;
+    if (ba_index_pread(rd, chunk, n, off) < 0)
+      return -1;
+
+    if (ba_buffer_write(buf, chunk, n) < 0)
+      return -1;
+
+    off += n;
+    size -= n;
+  }
+
+  return 0;
+}
+
+static int write_kept(ba_writer_t *wr, uint32_t i, ba_buffer_t *buf,
+                      uint8_t *chunk, struct ba_entry_header *ehdr,
+                      uint64_t *off) {
+  const struct ba_entry_column *col = &wr->entries[i];
+
+  share_payload(ehdr, &col->keep);
+
+  if (col->reuse == BA_REUSE_REF)
+    return 0;
+
+  if (col->keep.codc == BA_ENTRY_SOLID) {
+    struct ba_solid_block *block = &wr->solid.blocks[col->keep.bksz];
+    if (block->boff != 0)
+      return 0;
+
+    if (align_payload(wr, buf, block->bcsz, off) < 0)
+      return -1;
+
+    if (copy_raw(wr->source, buf, chunk, wr->solid.origin[col->keep.bksz],
+                 block->bcsz) < 0)
+      return -1;
+
+    block->boff = *off;
+    *off += block->bcsz;
+
+    return 0;
+  }
+
+  if (align_payload(wr, buf, col->keep.bcsz, off) < 0 ||
+      copy_raw(wr->source, buf, chunk, col->keep.boff, col->keep.bcsz) < 0)
+    return -1;
+
+  ehdr->boff = *off;
+  *off += ehdr->bcsz;
+
+  return 0;
+}
+
+static int stream_entry(struct ba_write_pool *pool, uint32_t i,
+                        uint8_t *chunk) {
+  ba_writer_t *wr = pool->wr;
+  struct ba_write_job *job = &pool->jobs[i];
+  uint64_t cap =
+      wr->buffer_size > BA_WRITE_SCRATCH ? wr->buffer_size : BA_WRITE_SCRATCH;
+
+  if (column_open(&wr->entries[i]) < 0)
+    return -1;
+
+  if (ba_buffer_init_pipe(&job->out, cap) < 0) {
+    column_close(&wr->entries[i]);
+    return -1;
+  }
+
+  ba_mutex_lock(&pool->lock);
+  if (pool->stop) {
+    ba_mutex_unlock(&pool->lock);
+    ba_buffer_free(&job->out);
+    column_close(&wr->entries[i]);
+    errno = ECANCELED;
+    return -1;
+  }
+  job->stream = 1;
+  job->state = BA_JOB_STREAM;
+  ba_cond_broadcast(&pool->cond);
+  ba_mutex_unlock(&pool->lock);
+
+  int ret = write_source(wr, i, job->out, chunk, 0, &job->ehdr);
+  int err = errno;
+  ba_buffer_close_pipe(job->out);
+  column_close(&wr->entries[i]);
+  errno = err;
+
+  return ret;
+}
+
+static int drain_stream(ba_writer_t *wr, struct ba_write_pool *pool,
+                        uint32_t i, ba_buffer_t *buf, uint8_t *chunk,
+                        struct ba_entry_header *ehdr, uint64_t *off) {
+  struct ba_write_job *job = &pool->jobs[i];
+
+  if (align_payload(wr, buf, column_size(&wr->entries[i]), off) < 0) {
+    ba_buffer_close_pipe(job->out);
+    return -1;
+  }
+
+  uint64_t size = 0;
+  uint64_t n;
+  while ((n = ba_buffer_read(job->out, chunk, BA_WRITE_CHUNK)) != 0) {
+    if (ba_buffer_write(buf, chunk, n) < 0) {
+      ba_buffer_close_pipe(job->out);
+      return -1;
+    }
+    size += n;
+  }
+
+  ba_mutex_lock(&pool->lock);
+  while (job->state == BA_JOB_STREAM)
+    ba_cond_wait(&pool->cond, &pool->lock);
+  ba_mutex_unlock(&pool->lock);
+
+  if (job->state == BA_JOB_FAILED) {
+    errno = job->err;
+    return -1;
+  }
+
+  if (size != job->ehdr.bcsz) {
+    errno = EIO;
+    return -1;
+  }
+
+  ehdr->boff = *off;
+  ehdr->bosz = job->ehdr.bosz;
+  ehdr->bcsz = job->ehdr.bcsz;
+  ehdr->flag = job->ehdr.flag;
+  ehdr->codc = job->ehdr.codc;
+  ehdr->bksz = job->ehdr.bksz;
+  *off += size;
+
+  ba_buffer_free(&job->out);
+
+  return 0;
+}
+
+static void write_worker(void *arg) {
+  struct ba_write_pool *pool = arg;
+  uint8_t *chunk = malloc(BA_WRITE_SCRATCH);
+
+  ba_mutex_lock(&pool->lock);
+  while (!pool->stop && pool->next < pool->wr->entry_size) {
+    if (pool->next >= pool->limit) {
+      ba_cond_wait(&pool->cond, &pool->lock);
+      continue;
+    }
+
+    uint32_t pos = pool->next++;
+    uint32_t i = layout_at(pool->wr, pos);
+    struct ba_write_job *job = &pool->jobs[i];
+    ba_mutex_unlock(&pool->lock);
+
+    const struct ba_solid_plan *plan = &pool->wr->solid;
+
+    int state = BA_JOB_FAILED;
+    if (pool->dupes[i] != BA_ENTRY_INVALID) {
+      state = BA_JOB_DUPE;
+    } else if (pool->wr->entries[i].reuse != BA_REUSE_NONE) {
+      state = BA_JOB_KEPT;
+    } else if (in_solid(pool->wr, i)) {
+      if (plan->first[plan->block_of[i]] != pos)
+        state = BA_JOB_SOLID;
+      else if (chunk != NULL && encode_solid(pool->wr, plan->block_of[i], chunk,
+                                             &job->out, &job->ehdr) == 0)
+        state = BA_JOB_BLOCK;
+    } else if (column_size(&pool->wr->entries[i]) > pool->wr->buffer_size) {
+      if (chunk != NULL && stream_entry(pool, i, chunk) == 0)
+        state = BA_JOB_DONE;
+    } else if (chunk != NULL && column_open(&pool->wr->entries[i]) == 0) {
+      if (encode_entry(pool->wr, i, chunk, &job->out, &job->ehdr) == 0)
+        state = BA_JOB_DONE;
+      if (state != BA_JOB_DONE || job->out != NULL)
+        column_close(&pool->wr->entries[i]);
+    }
+    int err = errno;
+
+    ba_mutex_lock(&pool->lock);
+    job->state = state;
+    job->err = err;
+    ba_cond_broadcast(&pool->cond);
+  }
+  ba_mutex_unlock(&pool->lock);
+
+  free(chunk);
+}
+
+static int write_entries_parallel(ba_writer_t *wr, ba_buffer_t *buf,
+                                  uint8_t *chunk,
+                                  struct ba_entry_header *entry_headers,
+                                  const uint32_t *dupes, uint64_t *off) {
+  uint32_t threads =
+      wr->threads < wr->entry_size ? wr->threads : wr->entry_size;
+
+  struct ba_write_pool pool = {0};
+  pool.wr = wr;
+  pool.dupes = dupes;
+  pool.limit = threads * 2;
+
+  pool.jobs = calloc(wr->entry_size, sizeof(*pool.jobs));
+  if (pool.jobs == NULL)
+    return -1;
+
+  ba_thread_t *workers = calloc(threads, sizeof(*workers));
+  if (workers == NULL) {
+    free(pool.jobs);
+    return -1;
+  }
+
+  if (ba_mutex_init(&pool.lock) < 0) {
+    free(workers);
+    free(pool.jobs);
+    return -1;
+  }
+
+  if (ba_cond_init(&pool.cond) < 0) {
+    ba_mutex_destroy(&pool.lock);
+    free(workers);
+    free(pool.jobs);
+    return -1;
+  }
+
+  uint32_t started = 0;
+  while (started < threads &&
+         ba_thread_create(&workers[started], write_worker, &pool) == 0)
+    started++;
+
+  int ret = started == 0 ? -1 : 0;
+
+  for (uint32_t pos = 0; ret == 0 && pos < wr->entry_size; pos++) {
+    uint32_t i = layout_at(wr, pos);
+    struct ba_write_job *job = &pool.jobs[i];
+
+    ba_mutex_lock(&pool.lock);
+    while (job->state == BA_JOB_PENDING)
+      ba_cond_wait(&pool.cond, &pool.lock);
+    int stream = job->stream;
+    ba_mutex_unlock(&pool.lock);
+
+    if (stream) {
+      if (drain_stream(wr, &pool, i, buf, chunk, &entry_headers[i], off) < 0) {
+        ret = -1;
+        break;
+      }
+
+      ba_mutex_lock(&pool.lock);
+      pool.limit++;
+      ba_cond_broadcast(&pool.cond);
+      ba_mutex_unlock(&pool.lock);
+      continue;
+    }
+
+    if (job->state == BA_JOB_FAILED) {
+      errno = job->err;
+      ret = -1;
+      break;
+    }
+
+    if (job->state == BA_JOB_BLOCK) {
+      if (write_solid(wr, wr->solid.block_of[i], buf, job->out, chunk,
+                      &job->ehdr, off) < 0) {
+        ret = -1;
+        break;
+      }
+      ba_buffer_free(&job->out);
+    }
+
+    if (job->state == BA_JOB_KEPT &&
+        write_kept(wr, i, buf, chunk, &entry_headers[i], off) < 0) {
+      ret = -1;
+      break;
+    }
+
+    if (job->state == BA_JOB_DUPE || job->state == BA_JOB_SOLID ||
+        job->state == BA_JOB_BLOCK || job->state == BA_JOB_KEPT) {
+      ba_mutex_lock(&pool.lock);
+      pool.limit++;
+      ba_cond_broadcast(&pool.cond);
+      ba_mutex_unlock(&pool.lock);
+      continue;
+    }
+
+    if (align_payload(wr, buf, job->ehdr.bcsz, off) < 0) {
+      ret = -1;
+      break;
+    }
+
+    entry_headers[i].boff = *off;
+    entry_headers[i].bosz = job->ehdr.bosz;
+    entry_headers[i].bcsz = job->ehdr.bcsz;
+    entry_headers[i].flag = job->ehdr.flag;
+    entry_headers[i].codc = job->ehdr.codc;
+    entry_headers[i].bksz = job->ehdr.bksz;
+
+    if (job->out == NULL) {
+      ba_buffer_t *src = wr->entries[i].buf;
+      int failed = ba_buffer_seek(src, 0, SEEK_SET) < 0 ||
+                   store_to(buf, chunk, src, job->ehdr.bosz) < 0;
+      column_close(&wr->entries[i]);
+      if (failed) {
+        ret = -1;
+        break;
+      }
+    } else if (copy_buffer(buf, job->out, chunk) < 0) {
+      ret = -1;
+      break;
+    }
+    *off += job->ehdr.bcsz;
+    ba_buffer_free(&job->out);
+
+    ba_mutex_lock(&pool.lock);
+    pool.limit++;
+    ba_cond_broadcast(&pool.cond);
+    ba_mutex_unlock(&pool.lock);
+  }
+
+  ba_mutex_lock(&pool.lock);
+  pool.stop = 1;
+  ba_cond_broadcast(&pool.cond);
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    if (pool.jobs[i].stream && pool.jobs[i].out != NULL)
+      ba_buffer_close_pipe(pool.jobs[i].out);
+  ba_mutex_unlock(&pool.lock);
+
+  for (uint32_t i = 0; i < started; i++)
+    ba_thread_join(&workers[i]);
+
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    ba_buffer_free(&pool.jobs[i].out);
+
+  ba_cond_destroy(&pool.cond);
+  ba_mutex_destroy(&pool.lock);
+  free(workers);
+  free(pool.jobs);
+
+  return ret;
+}
+
+static int write_stub(ba_buffer_t *buf, uint64_t end) {
+  struct ba_archive_header stub = {0};
+  stub.sign = BA_SIGNATURE_V2;
+  stub.tbsz = end;
+
+  struct ba_archive_extension stub_extension = {0};
+  stub_extension.flag = BA_ARCHIVE_TRAILING;
+
+  if (ba_buffer_write(buf, &stub, sizeof(stub)) < 0)
+    return -1;
+
+  if (ba_buffer_write(buf, &stub_extension, sizeof(stub_extension)) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int range_compare(const void *lhs, const void *rhs) {
+  const struct ba_payload_range *a = lhs;
+  const struct ba_payload_range *b = rhs;
+
+  if (a->off != b->off)
+    return a->off < b->off ? -1 : 1;
+  return 0;
+}
+
+static int live_size(const ba_writer_t *wr,
+                     const struct ba_entry_header *entry_headers,
+                     uint64_t *size) {
+  struct ba_payload_range *ranges =
+      malloc((wr->entry_size + wr->solid.count + 1) * sizeof(*ranges));
+  if (ranges == NULL)
+    return -1;
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    const struct ba_entry_header *ehdr = &entry_headers[i];
+    if (ehdr->codc == BA_ENTRY_SOLID) {
+      const struct ba_solid_block *block = &wr->solid.blocks[ehdr->bksz];
+      ranges[count].off = block->boff;
+      ranges[count].size = block->bcsz;
+    } else {
+      ranges[count].off = ehdr->boff;
+      ranges[count].size = ehdr->bcsz;
+    }
+
+    if (ranges[count].size != 0)
+      count++;
+  }
+  qsort(ranges, count, sizeof(*ranges), range_compare);
+
+  *size = 0;
+  for (uint32_t i = 0; i < count; i++)
+    if (i == 0 || ranges[i].off != ranges[i - 1].off)
+      *size += ranges[i].size;
+
+  free(ranges);
+
+  return 0;
+}
+
+static int reserve_regions(ba_writer_t *wr) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    if (wr->entries[i].preload)
+      count++;
+
+  if (count > wr->region_cap) {
+    struct ba_preload_info *regions =
+        realloc(wr->regions, count * sizeof(*regions));
+    if (regions == NULL)
+      return -1;
+    wr->regions = regions;
+    wr->region_cap = count;
+  }
+
+  if (count != 0)
+    memset(wr->regions, 0, count * sizeof(*wr->regions));
+  wr->region_count = count;
+
+  return 0;
+}
+
+static int region_compare(const void *lhs, const void *rhs) {
+  const struct ba_preload_info *a = lhs;
+  const struct ba_preload_info *b = rhs;
+
+  if (a->boff != b->boff)
+    return a->boff < b->boff ? -1 : 1;
+  return 0;
+}
+
+static void mark_preload(ba_writer_t *wr,
+                         struct ba_entry_header *entry_headers) {
+  uint32_t count = 0;
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    struct ba_entry_header *ehdr = &entry_headers[i];
+    if (!wr->entries[i].preload) {
+      ehdr->flag &= ~BA_ENTRY_PRELOAD;
+      continue;
+    }
+    ehdr->flag |= BA_ENTRY_PRELOAD;
+
+    uint64_t boff = ehdr->boff, bcsz = ehdr->bcsz;
+    if (ehdr->codc == BA_ENTRY_SOLID) {
+      boff = wr->solid.blocks[ehdr->bksz].boff;
+      bcsz = wr->solid.blocks[ehdr->bksz].bcsz;
+    }
+
+    if (bcsz == 0)
+      continue;
+    wr->regions[count].boff = boff;
+    wr->regions[count].bsiz = bcsz;
+    count++;
+  }
+
+  if (count == 0) {
+    wr->region_count = 0;
+    return;
+  }
+
+  qsort(wr->regions, count, sizeof(*wr->regions), region_compare);
+
+  uint32_t merged = 0;
+  for (uint32_t i = 1; i < count; i++) {
+    struct ba_preload_info *last = &wr->regions[merged];
+    uint64_t end = last->boff + last->bsiz;
+    if (wr->regions[i].boff <= end + BA_PRELOAD_GAP) {
+      uint64_t next = wr->regions[i].boff + wr->regions[i].bsiz;
+      if (next > end)
+        last->bsiz = next - last->boff;
+      continue;
+    }
+
+    wr->regions[++merged] = wr->regions[i];
+  }
+
+  memset(&wr->regions[merged + 1], 0,
+         (count - merged - 1) * sizeof(*wr->regions));
+  wr->region_count = merged + 1;
+}
+
+static int write_archive(ba_writer_t *wr, ba_buffer_t *buf, uint8_t *chunk,
+                         const uint32_t *dupes) {
+  struct ba_archive_header header = {0};
+  header.sign = BA_SIGNATURE_V2;
+  header.ensz = wr->entry_size;
+
+  struct ba_archive_extension extension = {0};
+  struct ba_section_header sections[6] = {0};
+
+  if (wr->hash_index)
+    sections[extension.sccn++].type = BA_SECTION_HASH;
+  if (wr->dict_len != 0)
+    sections[extension.sccn++].type = BA_SECTION_DICT;
+  if (wr->solid.count != 0)
+    sections[extension.sccn++].type = BA_SECTION_SOLID;
+  if (wr->append_at != 0)
+    sections[extension.sccn++].type = BA_SECTION_UPDATE;
+  if (wr->sources)
+    sections[extension.sccn++].type = BA_SECTION_SOURCE;
+  if (reserve_regions(wr) < 0)
+    return -1;
+  if (wr->region_count != 0)
+    sections[extension.sccn++].type = BA_SECTION_PRELOAD;
+
+  int trailing = wr->trailing_index || wr->append_at != 0;
+
+  uint64_t header_size = sizeof(header) + sizeof(extension) +
+                         extension.sccn * sizeof(*sections) +
+                         wr->entry_size * sizeof(struct ba_entry_header);
+
+  struct ba_entry_header *entry_headers =
+      calloc(wr->entry_size, sizeof(*entry_headers));
+  if (entry_headers == NULL)
+    return -1;
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    entry_headers[i].tidx = header.tbsz;
+    entry_headers[i].tlen = wr->entries[i].nlen;
+
+    header.tbsz += entry_headers[i].tlen;
+
+    if (in_solid(wr, i)) {
+      entry_headers[i].boff = wr->solid.offset_of[i];
+      entry_headers[i].bosz = column_size(&wr->entries[i]);
+      entry_headers[i].codc = BA_ENTRY_SOLID;
+      entry_headers[i].bksz = wr->solid.block_of[i];
+    }
+  }
+
+  uint64_t off;
+
+  if (!trailing) {
+    if (ba_buffer_seek(buf, header_size, SEEK_SET) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    if (write_names(wr, buf) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    off = plan_sections(wr, sections, extension.sccn,
+                        header_size + header.tbsz);
+
+    if (write_sections(wr, buf, sections, extension.sccn,
+                       header_size + header.tbsz) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+  } else if (wr->append_at != 0) {
+    if (ba_buffer_seek(buf, wr->append_at, SEEK_SET) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    off = wr->append_at;
+  } else {
+    if (write_stub(buf, 0) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    off = sizeof(header) + sizeof(extension);
+  }
+
+  if (wr->threads > 1 && wr->entry_size > 1) {
+    if (write_entries_parallel(wr, buf, chunk, entry_headers, dupes, &off) <
+        0) {
+      free(entry_headers);
+      return -1;
+    }
+  } else {
+    for (uint32_t pos = 0; pos < wr->entry_size; pos++) {
+      uint32_t i = layout_at(wr, pos);
+      if (dupes[i] != BA_ENTRY_INVALID)
+        continue;
+
+      if (wr->entries[i].reuse != BA_REUSE_NONE) {
+        if (write_kept(wr, i, buf, chunk, &entry_headers[i], &off) < 0) {
+          free(entry_headers);
+          return -1;
+        }
+        continue;
+      }
+
+      if (in_solid(wr, i)) {
+        uint32_t b = wr->solid.block_of[i];
+        if (wr->solid.first[b] != pos)
+          continue;
+
+        ba_buffer_t *out;
+        struct ba_entry_header block = {0};
+        if (encode_solid(wr, b, chunk, &out, &block) < 0) {
+          free(entry_headers);
+          return -1;
+        }
+
+        if (write_solid(wr, b, buf, out, chunk, &block, &off) < 0) {
+          ba_buffer_free(&out);
+          free(entry_headers);
+          return -1;
+        }
+
+        ba_buffer_free(&out);
+        continue;
+      }
+
+      if (align_payload(wr, buf, column_size(&wr->entries[i]), &off) < 0 ||
+          write_entry(wr, i, buf, chunk, off, &entry_headers[i]) < 0) {
+        free(entry_headers);
+        return -1;
+      }
+      off += entry_headers[i].bcsz;
+    }
+  }
+
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    if (dupes[i] != BA_ENTRY_INVALID)
+      share_payload(&entry_headers[i], &entry_headers[dupes[i]]);
+
+  mark_preload(wr, entry_headers);
+
+  if (!trailing) {
+    if (ba_buffer_seek(buf, 0, SEEK_SET) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    if (write_headers(wr, buf, &header, &extension, sections, entry_headers) <
+        0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    free(entry_headers);
+
+    for (uint32_t i = 0; i < extension.sccn; i++) {
+      const void *data;
+      if (sections[i].type == BA_SECTION_SOLID)
+        data = wr->solid.blocks;
+      else if (sections[i].type == BA_SECTION_PRELOAD)
+        data = wr->regions;
+      else
+        continue;
+
+      if (ba_buffer_seek(buf, sections[i].soff, SEEK_SET) < 0 ||
+          ba_buffer_write(buf, data, sections[i].ssiz) < 0)
+        return -1;
+    }
+
+    return 0;
+  }
+
+  struct ba_archive_footer footer = {0};
+  footer.ioff = (off + 7) & ~(uint64_t)7;
+  footer.sign = BA_SIGNATURE_V2;
+
+  if (write_padding(buf, footer.ioff - off) < 0) {
+    free(entry_headers);
+    return -1;
+  }
+
+  if (wr->append_at != 0) {
+    uint64_t live;
+    if (live_size(wr, entry_headers, &live) < 0) {
+      free(entry_headers);
+      return -1;
+    }
+
+    wr->update.dead = off - sizeof(header) - sizeof(extension) - live;
+  }
+
+  off = footer.ioff + header_size + header.tbsz;
+  uint64_t end = plan_sections(wr, sections, extension.sccn, off);
+
+  if (write_headers(wr, buf, &header, &extension, sections, entry_headers) <
+      0) {
+    free(entry_headers);
+    return -1;
+  }
+
+  free(entry_headers);
+
+  if (write_names(wr, buf) < 0)
+    return -1;
+
+  if (write_sections(wr, buf, sections, extension.sccn, off) < 0)
+    return -1;
+
+  if (write_padding(buf, -end & 7) < 0)
+    return -1;
+
+  if (ba_buffer_write(buf, &footer, sizeof(footer)) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int keep_dictionary(ba_writer_t *wr, const ba_reader_t *rd) {
+  free(wr->dict);
+  wr->dict = NULL;
+  wr->dict_len = 0;
+
+  uint32_t len;
+  const uint8_t *dict = ba_index_dict(rd, &len);
+  if (len == 0)
+    return 0;
+
+  wr->dict = malloc(len);
+  if (wr->dict == NULL)
+    return -1;
+
+  memcpy(wr->dict, dict, len);
+  wr->dict_len = len;
+
+  return 0;
+}
+
+static int keep_solid(ba_writer_t *wr, const ba_reader_t *rd,
+                      struct ba_entry_column *cols, uint32_t size,
+                      int compact) {
+  struct ba_solid_plan *plan = &wr->solid;
+
+  solid_clear(plan);
+
+  uint32_t count;
+  const struct ba_solid_block *blocks = ba_index_solid(rd, &count);
+  if (count == 0)
+    return 0;
+
+  uint32_t *remap = malloc(count * sizeof(*remap));
+  plan->blocks = malloc(count * sizeof(*plan->blocks));
+  plan->origin = malloc(count * sizeof(*plan->origin));
+  if (remap == NULL || plan->blocks == NULL || plan->origin == NULL) {
+    free(remap);
+    solid_clear(plan);
+    return -1;
+  }
+
+  for (uint32_t b = 0; b < count; b++)
+    remap[b] = compact ? BA_ENTRY_INVALID : b;
+
+  for (uint32_t i = 0; i < size; i++) {
+    struct ba_entry_header *keep = &cols[i].keep;
+    if (cols[i].reuse == BA_REUSE_NONE || keep->codc != BA_ENTRY_SOLID)
+      continue;
+
+    if (keep->bksz >= count) {
+      free(remap);
+      solid_clear(plan);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (remap[keep->bksz] == BA_ENTRY_INVALID)
+      remap[keep->bksz] = plan->count++;
+    keep->bksz = remap[keep->bksz];
+  }
+
+  if (!compact)
+    plan->count = count;
+
+  for (uint32_t b = 0; b < count; b++) {
+    if (remap[b] == BA_ENTRY_INVALID)
+      continue;
+
+    plan->blocks[remap[b]] = blocks[b];
+    plan->origin[remap[b]] = blocks[b].boff;
+    if (compact)
+      plan->blocks[remap[b]].boff = 0;
+  }
+
+  free(remap);
+
+  if (plan->count == 0)
+    solid_clear(plan);
+
+  return 0;
+}
+
+static int order_name_compare(const void *lhs, const void *rhs) {
+  const struct ba_order_key *a = lhs;
+  const struct ba_order_key *b = rhs;
+
+  int cmp = memcmp(a->name, b->name, a->nlen < b->nlen ? a->nlen : b->nlen);
+  if (cmp != 0)
+    return cmp;
+  if (a->nlen != b->nlen)
+    return a->nlen < b->nlen ? -1 : 1;
+  if (a->rank != b->rank)
+    return a->rank < b->rank ? -1 : 1;
+  return 0;
+}
+
+static int order_rank_compare(const void *lhs, const void *rhs) {
+  const struct ba_order_key *a = lhs;
+  const struct ba_order_key *b = rhs;
+
+  if (a->group != b->group)
+    return a->group < b->group ? -1 : 1;
+  if (a->rank != b->rank)
+    return a->rank < b->rank ? -1 : 1;
+  if (a->id != b->id)
+    return a->id < b->id ? -1 : 1;
+  return 0;
+}
+
+static int read_order(const char *filename, char **text,
+                      struct ba_order_key **keys, uint32_t *count) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+
+  uint64_t size = ba_buffer_size(buf);
+  *text = malloc(size + 1);
+  if (*text == NULL) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_buffer_read(buf, *text, size) != size) {
+    free(*text);
+    ba_buffer_free(&buf);
+    errno = EIO;
+    return -1;
+  }
+  (*text)[size] = '\n';
+
+  ba_buffer_free(&buf);
+
+  uint64_t lines = 0;
+  for (uint64_t i = 0; i <= size; i++)
+    lines += (*text)[i] == '\n';
+
+  if (lines > UINT32_MAX) {
+    free(*text);
+    errno = EINVAL;
+    return -1;
+  }
+
+  *keys = malloc(lines * sizeof(**keys));
+  if (*keys == NULL) {
+    free(*text);
+    return -1;
+  }
+
+  *count = 0;
+  for (uint64_t i = 0, start = 0; i <= size; i++) {
+    if ((*text)[i] != '\n')
+      continue;
+
+    uint64_t end = i;
+    if (end > start && (*text)[end - 1] == '\r')
+      end--;
+
+    if (end > start) {
+      (*keys)[*count].name = &(*text)[start];
+      (*keys)[*count].nlen = end - start;
+      (*keys)[*count].rank = *count;
+      (*count)++;
+    }
+
+    start = i + 1;
+  }
+
+  qsort(*keys, *count, sizeof(**keys), order_name_compare);
+
+  return 0;
+}
+
+static uint32_t find_rank(const struct ba_order_key *list, uint32_t count,
+                          const struct ba_order_key *key) {
+  uint32_t lo = 0, hi = count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (order_name_compare(&list[mid], key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < count && list[lo].nlen == key->nlen &&
+      memcmp(list[lo].name, key->name, key->nlen) == 0)
+    return list[lo].rank;
+  return UINT32_MAX;
+}
+
+static int order_entries(ba_writer_t *wr) {
+  if ((wr->order == NULL && wr->preload == NULL) || wr->entry_size == 0)
+    return 0;
+
+  char *text = NULL;
+  struct ba_order_key *trace = NULL;
+  uint32_t count = 0;
+  if (wr->order != NULL && read_order(wr->order, &text, &trace, &count) < 0)
+    return -1;
+
+  char *marks = NULL;
+  struct ba_order_key *preload = NULL;
+  uint32_t marked = 0;
+  if (wr->preload != NULL &&
+      read_order(wr->preload, &marks, &preload, &marked) < 0) {
+    free(trace);
+    free(text);
+    return -1;
+  }
+
+  struct ba_order_key *keys = malloc(wr->entry_size * sizeof(*keys));
+  wr->layout = malloc(wr->entry_size * sizeof(*wr->layout));
+  if (keys == NULL || wr->layout == NULL) {
+    free(wr->layout);
+    wr->layout = NULL;
+    free(keys);
+    free(preload);
+    free(marks);
+    free(trace);
+    free(text);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    keys[i].name = wr->entries[i].name;
+    keys[i].nlen = wr->entries[i].nlen;
+    keys[i].rank = 0;
+    keys[i].id = i;
+
+    wr->entries[i].preload = find_rank(preload, marked, &keys[i]) != UINT32_MAX;
+    keys[i].group = !wr->entries[i].preload;
+    keys[i].rank = find_rank(trace, count, &keys[i]);
+  }
+  qsort(keys, wr->entry_size, sizeof(*keys), order_rank_compare);
+
+  for (uint32_t i = 0; i < wr->entry_size; i++)
+    wr->layout[i] = keys[i].id;
+
+  free(keys);
+  free(preload);
+  free(marks);
+  free(trace);
+  free(text);
+
+  return 0;
+}
+
+static int open_previous(const ba_writer_t *wr, ba_reader_t **rd) {
+  *rd = NULL;
+
+  if (wr->previous == NULL)
+    return 0;
+
+  if (ba_reader_alloc(rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(*rd, wr->previous) < 0) {
+    int err = errno;
+    ba_reader_free(rd);
+    if (err == ENOENT)
+      return 0;
+
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int reuse_previous(ba_writer_t *wr, const ba_reader_t *rd,
+                          uint8_t *chunk, int *keep_dict) {
+  *keep_dict = 0;
+
+  const struct ba_source_info *sources = ba_index_sources(rd);
+  if (sources == NULL)
+    return 0;
+
+  const struct ba_entry_header *ehdr = ba_index_entries(rd);
+  uint32_t count;
+  const struct ba_solid_block *blocks = ba_index_solid(rd, &count);
+
+  uint32_t *match = malloc((wr->entry_size + 1) * sizeof(*match));
+  uint32_t *members = calloc(count + 1, sizeof(*members));
+  if (match == NULL || members == NULL) {
+    free(members);
+    free(match);
+    return -1;
+  }
+
+  for (uint32_t id = 0; id < ba_reader_size(rd); id++)
+    if (ehdr[id].codc == BA_ENTRY_SOLID && ehdr[id].bksz < count)
+      members[ehdr[id].bksz]++;
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    struct ba_entry_column *col = &wr->entries[i];
+    match[i] = BA_ENTRY_INVALID;
+
+    ba_id_t id = ba_reader_find_entry(rd, col->name, col->nlen);
+    if (id == BA_ENTRY_INVALID || sources[id].size != col->source.size ||
+        ehdr[id].bosz != col->source.size)
+      continue;
+
+    if (col->source.mtim == 0 || col->source.mtim != sources[id].mtim) {
+      if (hash_content(col, chunk, col->source.size, &col->source.hash) < 0) {
+        free(members);
+        free(match);
+        return -1;
+      }
+
+      if (col->source.hash != sources[id].hash)
+        continue;
+    }
+
+    match[i] = id;
+    if (ehdr[id].codc == BA_ENTRY_SOLID && ehdr[id].bksz < count)
+      members[ehdr[id].bksz]--;
+  }
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    ba_id_t id = match[i];
+    if (id == BA_ENTRY_INVALID)
+      continue;
+
+    uint16_t flag = ehdr[id].flag;
+    if (ehdr[id].codc == BA_ENTRY_SOLID) {
+      if (ehdr[id].bksz >= count || members[ehdr[id].bksz] != 0)
+        continue;
+      flag = blocks[ehdr[id].bksz].flag;
+    }
+
+    struct ba_entry_column *col = &wr->entries[i];
+    col->reuse = BA_REUSE_COPY;
+    col->keep = ehdr[id];
+    col->source.hash = sources[id].hash;
+
+    if (flag & BA_ENTRY_DICT)
+      *keep_dict = 1;
+  }
+
+  free(members);
+  free(match);
+
+  if (*keep_dict && keep_dictionary(wr, rd) < 0)
+    return -1;
+
+  return keep_solid(wr, rd, wr->entries, wr->entry_size, 1);
+}
+
+static int hash_sources(ba_writer_t *wr, uint8_t *chunk) {
+  /* A source modified in the current second can change again without its
+   * mtime moving, so record no mtime and let the next write hash it. */
+  int64_t now = (int64_t)time(NULL);
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    struct ba_entry_column *col = &wr->entries[i];
+    if (col->source.mtim >= now)
+      col->source.mtim = 0;
+
+    if (col->reuse != BA_REUSE_NONE)
+      continue;
+
+    col->source.size = column_size(col);
+    if (hash_content(col, chunk, col->source.size, &col->source.hash) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* A symlink is replaced through to its target, not by a regular file. */
+static char *target_name(const char *filename) {
+#ifndef _WIN32
+  struct stat st;
+  if (lstat(filename, &st) == 0 && S_ISLNK(st.st_mode))
+    return realpath(filename, NULL);
+#endif
+
+  size_t len = strlen(filename) + 1;
+  char *target = malloc(len);
+  if (target != NULL)
+    memcpy(target, filename, len);
+
+  return target;
+}
+
+/* Creates a file next to filename under a fresh name. With O_EXCL an existing
+ * file or symlink of that name is never opened, so each writer gets its own. */
+static int open_temp(const char *filename, char **temp, ba_buffer_t **buf,
+                     FILE **fp) {
+  size_t len = strlen(filename);
+  *temp = malloc(len + 14);
+  if (*temp == NULL)
+    return -1;
+  memcpy(*temp, filename, len);
+
+#ifdef _WIN32
+  uint32_t seed = (uint32_t)_getpid() * 2654435761u;
+#else
+  uint32_t seed = (uint32_t)getpid() * 2654435761u;
+#endif
+  seed ^= (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)*temp;
+
+  int fd = -1;
+  for (uint32_t i = 0; fd < 0 && i < 100; i++) {
+    seed = seed * 1103515245u + 12345u;
+    snprintf(&(*temp)[len], 14, ".%08x.tmp", seed);
+
+#ifdef _WIN32
+    if (_sopen_s(&fd, *temp, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+                 _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0)
+      fd = -1;
+#else
+    fd = open(*temp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+#endif
+    if (fd < 0 && errno != EEXIST)
+      break;
+  }
+
+  if (fd < 0) {
+    free(*temp);
+    return -1;
+  }
+
+#ifdef _WIN32
+  *fp = _fdopen(fd, "wb");
+#else
+  struct stat st;
+  if (stat(filename, &st) == 0)
+    fchmod(fd, st.st_mode & 07777);
+
+  *fp = fdopen(fd, "wb");
+#endif
+  if (*fp == NULL) {
+    int err = errno;
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+    remove(*temp);
+    free(*temp);
+    errno = err;
+    return -1;
+  }
+
+  if (ba_buffer_init_fp(buf, *fp) < 0) {
+    int err = errno;
+    fclose(*fp);
+    remove(*temp);
+    free(*temp);
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int replace_file(const char *from, const char *to) {
+#ifdef _WIN32
+  if (!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)) {
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+#else
+  return rename(from, to);
+#endif
+}
+
+static FILE *open_file(const char *filename, const char *mode) {
+#ifdef _WIN32
+  FILE *fp;
+  if (fopen_s(&fp, filename, mode) != 0)
+    return NULL;
+  return fp;
+#else
+  return fopen(filename, mode);
+#endif
+}
+
+static int sync_file(FILE *fp) {
+  if (fflush(fp) != 0)
+    return -1;
+
+#ifdef _WIN32
+  return -(_commit(_fileno(fp)) != 0);
+#else
+  return -(fsync(fileno(fp)) != 0);
+#endif
+}
+
+static int truncate_file(const char *filename, uint64_t size) {
+#ifdef _WIN32
+  FILE *fp = open_file(filename, "r+b");
+  if (fp == NULL)
+    return -1;
+
+  int ret = -(_chsize_s(_fileno(fp), size) != 0);
+  fclose(fp);
+
+  return ret;
+#else
+  return truncate(filename, size);
+#endif
+}
+
+int ba_writer_write(ba_writer_t *wr, ba_buffer_t *buf) {
+  if (wr == NULL || buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint8_t *chunk = malloc(BA_WRITE_SCRATCH);
+  if (chunk == NULL)
+    return -1;
+
+  uint32_t *dupes = malloc((wr->entry_size ? wr->entry_size : 1) *
+                           sizeof(*dupes));
+  if (dupes == NULL) {
+    free(chunk);
+    return -1;
+  }
+
+  ba_reader_t *rd;
+  if (open_previous(wr, &rd) < 0) {
+    free(dupes);
+    free(chunk);
+    return -1;
+  }
+
+  if (order_entries(wr) < 0) {
+    if (rd != NULL)
+      ba_reader_free(&rd);
+    free(dupes);
+    free(chunk);
+    return -1;
+  }
+
+  solid_clear(&wr->solid);
+  wr->source = rd;
+  wr->sources = wr->previous != NULL;
+
+  int keep_dict = 0;
+  int ret = 0;
+  if ((rd != NULL && reuse_previous(wr, rd, chunk, &keep_dict) < 0) ||
+      (wr->sources && hash_sources(wr, chunk) < 0) ||
+      find_duplicates(wr, chunk, dupes) < 0 ||
+      (!keep_dict && train_dictionary(wr, dupes) < 0) ||
+      plan_solid(wr, dupes) < 0 || write_archive(wr, buf, chunk, dupes) < 0)
+    ret = -1;
+
+  for (uint32_t i = 0; i < wr->entry_size; i++) {
+    wr->entries[i].reuse = BA_REUSE_NONE;
+    wr->entries[i].preload = 0;
+  }
+  free(wr->layout);
+  wr->layout = NULL;
+  wr->source = NULL;
+
+  if (rd != NULL)
+    ba_reader_free(&rd);
+  free(dupes);
+  free(chunk);
+
+  return ret;
+}
+
+int ba_writer_write_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL || filename == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *target = target_name(filename);
+  if (target == NULL)
+    return -1;
+
+  char *temp;
+  ba_buffer_t *buf;
+  FILE *fp;
+  if (open_temp(target, &temp, &buf, &fp) < 0) {
+    free(target);
+    return -1;
+  }
+
+  int ret = ba_writer_write(wr, buf);
+  if (ret == 0)
+    ret = sync_file(fp);
+  ba_buffer_free(&buf);
+
+  if (ret == 0)
+    ret = replace_file(temp, target);
+  if (ret < 0) {
+    int err = errno;
+    remove(temp);
+    errno = err;
+  }
+
+  free(temp);
+  free(target);
+
+  return ret;
+}
+
+static int merge_entries(const ba_writer_t *wr, const ba_reader_t *rd,
+                         int reuse, struct ba_entry_column **cols,
+                         uint32_t *size) {
+  uint32_t count = ba_reader_size(rd);
+  const struct ba_entry_header *ehdr = ba_index_entries(rd);
+  const struct ba_source_info *sources = ba_index_sources(rd);
+
+  *cols = calloc(count + wr->entry_size + 1, sizeof(**cols));
+  if (*cols == NULL)
+    return -1;
+
+  uint32_t *replace = malloc((count + 1) * sizeof(*replace));
+  uint8_t *matched = calloc(wr->entry_size + 1, 1);
+  if (replace == NULL || matched == NULL) {
+    free(matched);
+    free(replace);
+    free(*cols);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+    replace[i] = BA_ENTRY_INVALID;
+
+  for (uint32_t j = 0; j < wr->entry_size; j++) {
+    ba_id_t id =
+        ba_reader_find_entry(rd, wr->entries[j].name, wr->entries[j].nlen);
+    if (id == BA_ENTRY_INVALID)
+      continue;
+
+    replace[id] = j;
+    matched[j] = 1;
+  }
+
+  *size = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    struct ba_entry_column *col = &(*cols)[(*size)++];
+
+    if (replace[i] != BA_ENTRY_INVALID) {
+      *col = wr->entries[replace[i]];
+      col->preload |= (ehdr[i].flag & BA_ENTRY_PRELOAD) != 0;
+      continue;
+    }
+
+    const char *name;
+    if (ba_reader_entry_name(rd, i, &name, &col->nlen) < 0) {
+      free(matched);
+      free(replace);
+      free(*cols);
+      return -1;
+    }
+
+    col->name = (char *)name;
+    col->reuse = reuse;
+    col->keep = ehdr[i];
+    col->preload = (ehdr[i].flag & BA_ENTRY_PRELOAD) != 0;
+    if (sources != NULL)
+      col->source = sources[i];
+  }
+
+  for (uint32_t j = 0; j < wr->entry_size; j++)
+    if (!matched[j])
+      (*cols)[(*size)++] = wr->entries[j];
+
+  free(matched);
+  free(replace);
+
+  return 0;
+}
+
+static int write_merged(ba_writer_t *wr, ba_buffer_t *buf,
+                        struct ba_entry_column *cols, uint32_t size) {
+  struct ba_entry_column *entries = wr->entries;
+  uint32_t entry_size = wr->entry_size;
+  uint32_t entry_cap = wr->entry_cap;
+
+  wr->entries = cols;
+  wr->entry_size = size;
+  wr->entry_cap = size;
+
+  int ret = -1;
+  uint8_t *chunk = malloc(BA_WRITE_SCRATCH);
+  uint32_t *dupes = malloc((size ? size : 1) * sizeof(*dupes));
+  if (chunk != NULL && dupes != NULL &&
+      (!wr->sources || hash_sources(wr, chunk) == 0) &&
+      find_duplicates(wr, chunk, dupes) == 0 &&
+      write_archive(wr, buf, chunk, dupes) == 0)
+    ret = 0;
+
+  free(dupes);
+  free(chunk);
+
+  wr->entries = entries;
+  wr->entry_size = entry_size;
+  wr->entry_cap = entry_cap;
+
+  return ret;
+}
+
+int ba_writer_update_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL || filename == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file_ex(rd, filename, BA_READER_LAZY) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  struct ba_entry_column *cols;
+  uint32_t size;
+  if (merge_entries(wr, rd, BA_REUSE_REF, &cols, &size) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  if (keep_dictionary(wr, rd) < 0 ||
+      keep_solid(wr, rd, cols, size, 0) < 0) {
+    free(cols);
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  wr->sources = wr->previous != NULL || ba_index_sources(rd) != NULL;
+
+  uint64_t append_at = ba_index_size(rd);
+  wr->update.gnum = ba_index_update(rd)->gnum + 1;
+  wr->append_at = append_at;
+
+  FILE *fp = NULL;
+  if (truncate_file(filename, append_at) == 0)
+    fp = open_file(filename, "r+b");
+  if (fp == NULL) {
+    wr->append_at = 0;
+    free(cols);
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_fp(&buf, fp) < 0) {
+    fclose(fp);
+    wr->append_at = 0;
+    free(cols);
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  int ret = write_merged(wr, buf, cols, size);
+  int64_t end = ret == 0 ? ba_buffer_tell(buf) : -1;
+  if (end < 0 || sync_file(fp) < 0)
+    ret = -1;
+
+  int stubbed = ret == 0;
+  if (stubbed && (ba_buffer_seek(buf, 0, SEEK_SET) < 0 ||
+                  write_stub(buf, end) < 0 || sync_file(fp) < 0))
+    ret = -1;
+
+  wr->append_at = 0;
+  memset(&wr->update, 0, sizeof(wr->update));
+
+  ba_buffer_free(&buf);
+  free(cols);
+  ba_reader_free(&rd);
+
+  if (ret < 0 && !stubbed) {
+    int err = errno;
+    truncate_file(filename, append_at);
+    errno = err;
+  }
+
+  return ret;
+}
+
+int ba_writer_compact_file(ba_writer_t *wr, const char *filename) {
+  if (wr == NULL || filename == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *target = target_name(filename);
+  if (target == NULL)
+    return -1;
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0) {
+    free(target);
+    return -1;
+  }
+
+  if (ba_reader_open_file(rd, target) < 0) {
+    ba_reader_free(&rd);
+    free(target);
+    return -1;
+  }
+
+  struct ba_entry_column *cols;
+  uint32_t size;
+  if (merge_entries(wr, rd, BA_REUSE_COPY, &cols, &size) < 0) {
+    ba_reader_free(&rd);
+    free(target);
+    return -1;
+  }
+
+  if (keep_dictionary(wr, rd) < 0 ||
+      keep_solid(wr, rd, cols, size, 1) < 0) {
+    free(cols);
+    ba_reader_free(&rd);
+    free(target);
+    return -1;
+  }
+
+  wr->sources = wr->previous != NULL || ba_index_sources(rd) != NULL;
+
+  char *temp;
+  ba_buffer_t *buf;
+  FILE *fp;
+  if (open_temp(target, &temp, &buf, &fp) < 0) {
+    free(cols);
+    ba_reader_free(&rd);
+    free(target);
+    return -1;
+  }
+
+  wr->source = rd;
+  int ret = write_merged(wr, buf, cols, size);
+  wr->source = NULL;
+
+  if (ret == 0)
+    ret = sync_file(fp);
+  ba_buffer_free(&buf);
+  free(cols);
+  ba_reader_free(&rd);
+
+  if (ret == 0)
+    ret = replace_file(temp, target);
+  if (ret < 0) {
+    int err = errno;
+    remove(temp);
+    errno = err;
+  }
+
+  free(temp);
+  free(target);
+
+  return ret;
+}
@@ -0,0 +1,59 @@
+#include "thread.h"
+#include <ba/buffer.h>
+#include <stdio.h>
+
+#define BENCH_WRITE 16
+#define BENCH_MIN 0x40000
+#define BENCH_MAX 0x400000
+
+static int run(uint64_t writes, int reserve) {
+  static const uint8_t chunk[BENCH_WRITE] = {1};
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0)
+    return -1;
+
+  uint64_t start = ba_time_ms();
+
+  if (reserve && ba_buffer_reserve(buf, writes * BENCH_WRITE) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  for (uint64_t i = 0; i < writes; i++) {
+    if (ba_buffer_write(buf, chunk, sizeof(chunk)) < 0) {
+      ba_buffer_free(&buf);
+      return -1;
+    }
+  }
+
+  uint64_t elapsed = ba_time_ms() - start;
+
+  void *ptr;
+  uint64_t size;
+  if (ba_buffer_detach(buf, &ptr, &size) < 0 ||
+      size != writes * BENCH_WRITE) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  ba_buffer_free_data(ptr);
+  ba_buffer_free(&buf);
+
+  printf("%8llu writes%s: %6llu ms, %6.2f ns/write\n",
+         (unsigned long long)writes, reserve ? " (reserved)" : "           ",
+         (unsigned long long)elapsed, elapsed * 1e6 / writes);
+
+  return 0;
+}
+
+int main(void) {
+  for (uint64_t writes = BENCH_MIN; writes <= BENCH_MAX; writes *= 2) {
+    if (run(writes, 0) < 0 || run(writes, 1) < 0) {
+      perror("bench_buffer");
+      return 1;
+    }
+  }
+
+  return 0;
+}
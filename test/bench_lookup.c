@@ -0,0 +1,162 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_LOOKUPS 1000000
+#define BENCH_SCAN_WORK 100000000
+#define BENCH_NAME 32
+#define BENCH_MAX 1000000
+#define BENCH_NAMES (BENCH_MAX + BENCH_MAX / 4)
+
+static int write_archive(const char *filename, uint32_t count, int hash) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_hash_index(wr, hash) < 0 ||
+      ba_writer_set_codec(wr, BA_CODEC_STORE, 0) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  for (uint32_t id = 0; id < count; id++) {
+    char name[BENCH_NAME];
+    fixture_name(id, name, sizeof(name));
+
+    uint8_t data[1];
+    fixture_fill(id, data, sizeof(data));
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, data, sizeof(data)) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static ba_id_t scan_entry(const ba_reader_t *rd, const char *name,
+                          uint64_t len) {
+  uint32_t count = ba_reader_size(rd);
+  for (ba_id_t id = 0; id < count; id++) {
+    const char *str;
+    uint64_t n;
+    if (ba_reader_entry_name(rd, id, &str, &n) == 0 && n == len &&
+        strncmp(str, name, len) == 0)
+      return id;
+  }
+
+  return BA_ENTRY_INVALID;
+}
+
+static int lookup(const ba_reader_t *rd, char (*names)[BENCH_NAME],
+                  uint32_t count, uint32_t lookups, int scan,
+                  double *ns_per_lookup) {
+  uint32_t x = 12345;
+
+  uint64_t start = ba_time_ms();
+  for (uint32_t i = 0; i < lookups; i++) {
+    x = x * 1103515245u + 12345u;
+    uint32_t id = (x >> 4) % (count + count / 4);
+    const char *name = names[id];
+
+    ba_id_t found = scan ? scan_entry(rd, name, strlen(name))
+                         : ba_reader_find_entry(rd, name, 0);
+    if (found != (id < count ? id : BA_ENTRY_INVALID))
+      return -1;
+  }
+  uint64_t elapsed = ba_time_ms() - start;
+
+  *ns_per_lookup = elapsed * 1e6 / lookups;
+
+  return 0;
+}
+
+static int run(const char *filename, uint32_t count,
+               char (*names)[BENCH_NAME]) {
+  static const char *const kinds[] = {"built", "stored"};
+
+  for (int hash = 0; hash <= 1; hash++) {
+    if (write_archive(filename, count, hash) < 0)
+      return -1;
+
+    uint64_t start = ba_time_ms();
+
+    ba_reader_t *rd;
+    if (ba_reader_alloc(&rd) < 0)
+      return -1;
+
+    if (ba_reader_open_file(rd, filename) < 0) {
+      ba_reader_free(&rd);
+      return -1;
+    }
+
+    uint64_t opened = ba_time_ms() - start;
+
+    double ns;
+    if (lookup(rd, names, count, BENCH_LOOKUPS, 0, &ns) < 0) {
+      ba_reader_free(&rd);
+      errno = EIO;
+      return -1;
+    }
+    printf("%8u entries, %-6s index: open %5llu ms, %8.1f ns/lookup\n", count,
+           kinds[hash], (unsigned long long)opened, ns);
+
+    if (hash) {
+      uint32_t lookups = BENCH_SCAN_WORK / count;
+      if (lookup(rd, names, count, lookups, 1, &ns) < 0) {
+        ba_reader_free(&rd);
+        errno = EIO;
+        return -1;
+      }
+      printf("%8u entries, linear scan:             %11.1f ns/lookup\n",
+             count, ns);
+    }
+
+    ba_reader_free(&rd);
+  }
+
+  return 0;
+}
+
+int main(void) {
+  static const uint32_t counts[] = {1000, 100000, BENCH_MAX};
+  const char *filename = "bench_lookup.ba";
+
+  char (*names)[BENCH_NAME] = malloc(BENCH_NAMES * sizeof(*names));
+  if (names == NULL) {
+    perror("malloc");
+    return 1;
+  }
+
+  for (uint32_t id = 0; id < BENCH_NAMES; id++)
+    fixture_name(id, names[id], sizeof(names[id]));
+
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+    if (run(filename, counts[i], names) < 0) {
+      perror(filename);
+      failed = 1;
+      break;
+    }
+  }
+
+  remove(filename);
+  free(names);
+
+  return failed;
+}
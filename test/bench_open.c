@@ -0,0 +1,128 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#define BENCH_ENTRIES 256
+#define BENCH_OPENS 1000
+
+#define BENCH_MAPPED 0
+#define BENCH_COPY 1
+#define BENCH_LAZY 2
+
+static int64_t resident_kib(void) {
+#ifdef __linux__
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL)
+    return -1;
+
+  unsigned long long size, resident;
+  int ret = fscanf(fp, "%llu %llu", &size, &resident);
+  fclose(fp);
+  if (ret != 2)
+    return -1;
+
+  return (int64_t)(resident * sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return -1;
+#endif
+}
+
+static int open_reader(ba_reader_t *rd, const char *filename, int mode) {
+  if (mode == BENCH_MAPPED)
+    return ba_reader_open_file(rd, filename);
+
+  if (mode == BENCH_LAZY)
+    return ba_reader_open_file_ex(rd, filename, BA_READER_LAZY);
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+
+  int ret = ba_reader_open(rd, buf);
+  ba_buffer_free(&buf);
+
+  return ret;
+}
+
+static int run(const char *filename, int mode) {
+  static const char *const modes[] = {"mapped", "copy", "lazy"};
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  int64_t before = resident_kib();
+  if (open_reader(rd, filename, mode) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+  int64_t after = resident_kib();
+
+  ba_reader_free(&rd);
+
+  uint64_t start = ba_time_ms();
+  for (uint32_t i = 0; i < BENCH_OPENS; i++) {
+    if (ba_reader_alloc(&rd) < 0)
+      return -1;
+
+    if (open_reader(rd, filename, mode) < 0) {
+      ba_reader_free(&rd);
+      return -1;
+    }
+
+    ba_reader_free(&rd);
+  }
+  uint64_t elapsed = ba_time_ms() - start;
+
+  printf("%-6s open: %9.1f us, ", modes[mode],
+         elapsed * 1000.0 / BENCH_OPENS);
+  if (before < 0 || after < 0)
+    printf("RSS n/a\n");
+  else
+    printf("RSS +%lld KiB\n", (long long)(after - before));
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "bench_open.ba";
+
+  uint8_t **expect = fixture_expect(BENCH_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  if (fixture_write(filename, expect, BENCH_ENTRIES) < 0) {
+    perror(filename);
+    fixture_free(expect, BENCH_ENTRIES);
+    return 1;
+  }
+
+  fixture_free(expect, BENCH_ENTRIES);
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") == 0) {
+    printf("archive: %llu KiB, %u entries\n",
+           (unsigned long long)(ba_buffer_size(buf) / 1024), BENCH_ENTRIES);
+    ba_buffer_free(&buf);
+  }
+
+  int failed = 0;
+  for (int mode = BENCH_MAPPED; mode <= BENCH_LAZY; mode++) {
+    if (run(filename, mode) < 0) {
+      perror(filename);
+      failed = 1;
+    }
+  }
+
+  remove(filename);
+
+  return failed;
+}
@@ -0,0 +1,114 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_ENTRIES 256
+#define BENCH_PASSES 4
+#define BENCH_MAX_THREADS 8
+
+struct worker {
+  ba_thread_t thread;
+  ba_reader_t *rd;
+  uint32_t first;
+  uint64_t bytes;
+  int failed;
+};
+
+static void worker_main(void *arg) {
+  struct worker *wk = arg;
+
+  uint8_t *scratch = malloc(fixture_size(0) + BENCH_ENTRIES * 0x1000);
+  if (scratch == NULL) {
+    wk->failed = 1;
+    return;
+  }
+
+  for (uint32_t i = 0; i < BENCH_PASSES * BENCH_ENTRIES; i++) {
+    ba_id_t id = (wk->first + i) % BENCH_ENTRIES;
+    if (ba_reader_read(wk->rd, id, scratch) < 0) {
+      wk->failed = 1;
+      break;
+    }
+    wk->bytes += fixture_size(id);
+  }
+
+  free(scratch);
+}
+
+static int run(ba_reader_t *rd, const char *mode, uint32_t threads) {
+  struct worker workers[BENCH_MAX_THREADS];
+
+  uint64_t start = ba_time_ms();
+
+  uint32_t started = 0;
+  for (; started < threads; started++) {
+    struct worker *wk = &workers[started];
+    wk->rd = rd;
+    wk->first = started * BENCH_ENTRIES / threads;
+    wk->bytes = 0;
+    wk->failed = 0;
+    if (ba_thread_create(&wk->thread, worker_main, wk) < 0)
+      break;
+  }
+
+  int failed = started != threads;
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < started; i++) {
+    ba_thread_join(&workers[i].thread);
+    failed |= workers[i].failed;
+    bytes += workers[i].bytes;
+  }
+
+  uint64_t elapsed = ba_time_ms() - start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  printf("%-6s %2u threads: %8.1f MiB/s\n", mode, threads,
+         bytes / 1048576.0 / (elapsed / 1000.0));
+
+  return failed ? -1 : 0;
+}
+
+int main(void) {
+  const char *filename = "bench_reader.ba";
+
+  uint8_t **expect = fixture_expect(BENCH_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  if (fixture_write(filename, expect, BENCH_ENTRIES) < 0) {
+    perror(filename);
+    fixture_free(expect, BENCH_ENTRIES);
+    return 1;
+  }
+
+  fixture_free(expect, BENCH_ENTRIES);
+
+  static const char *const modes[] = {"mapped", "lazy"};
+  static const uint32_t flags[] = {0, BA_READER_LAZY};
+
+  int failed = 0;
+  for (int m = 0; m < 2; m++) {
+    ba_reader_t *rd;
+    if (ba_reader_alloc(&rd) < 0 ||
+        ba_reader_open_file_ex(rd, filename, flags[m]) < 0) {
+      perror(filename);
+      ba_reader_free(&rd);
+      failed = 1;
+      continue;
+    }
+
+    for (uint32_t threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+      failed |= run(rd, modes[m], threads) < 0;
+
+    ba_reader_free(&rd);
+  }
+
+  remove(filename);
+
+  return failed;
+}
@@ -0,0 +1,154 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_ENTRIES 16384
+#define BENCH_PASSES 4
+#define BENCH_MAX_SIZE 4096
+
+static uint64_t entry_size(uint32_t id) {
+  return 256 + (id * 37u) % (BENCH_MAX_SIZE - 256);
+}
+
+static int write_archive(ba_buffer_t *out, uint32_t codec,
+                         uint64_t *elapsed) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_codec(wr, codec, -1) < 0 ||
+      ba_writer_set_dedup(wr, 0) < 0 || ba_writer_set_solid_size(wr, 0) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  uint8_t data[BENCH_MAX_SIZE];
+  for (uint32_t id = 0; id < BENCH_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+    fixture_fill(id, data, entry_size(id));
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, data, entry_size(id)) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  uint64_t start = ba_time_ms();
+  int ret = ba_writer_write(wr, out);
+  *elapsed = ba_time_ms() - start;
+
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int read_archive(ba_reader_t *rd, uint64_t *elapsed) {
+  uint8_t data[BENCH_MAX_SIZE];
+  uint8_t expect[BENCH_MAX_SIZE];
+
+  uint64_t start = ba_time_ms();
+  for (uint32_t pass = 0; pass < BENCH_PASSES; pass++) {
+    for (ba_id_t id = 0; id < BENCH_ENTRIES; id++) {
+      if (ba_reader_read(rd, id, data) < 0)
+        return -1;
+    }
+  }
+  *elapsed = ba_time_ms() - start;
+
+  for (ba_id_t id = 0; id < BENCH_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+    if (ba_reader_find_entry(rd, name, 0) != id ||
+        ba_reader_read(rd, id, data) < 0) {
+      errno = EIO;
+      return -1;
+    }
+
+    fixture_fill(id, expect, entry_size(id));
+    if (memcmp(data, expect, entry_size(id)) != 0) {
+      errno = EIO;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void report(const char *codec, const char *op, uint64_t entries,
+                   uint64_t bytes, uint64_t elapsed) {
+  if (elapsed == 0)
+    elapsed = 1;
+
+  printf("%-7s %-5s: %9.0f entries/s, %7.1f MiB/s\n", codec, op,
+         entries * 1000.0 / elapsed, bytes * 1000.0 / elapsed / 1048576);
+}
+
+static int run(uint32_t codec) {
+  static const char *const codecs[] = {"deflate", "store"};
+
+  uint64_t total = 0;
+  for (uint32_t id = 0; id < BENCH_ENTRIES; id++)
+    total += entry_size(id);
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0)
+    return -1;
+
+  uint64_t elapsed;
+  if (write_archive(buf, codec, &elapsed) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  report(codecs[codec], "write", BENCH_ENTRIES, total, elapsed);
+  printf("%-7s size : %llu of %llu KiB\n", codecs[codec],
+         (unsigned long long)(ba_buffer_size(buf) / 1024),
+         (unsigned long long)(total / 1024));
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_reader_open(rd, buf) < 0) {
+    ba_reader_free(&rd);
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  ba_buffer_free(&buf);
+
+  if (read_archive(rd, &elapsed) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+  report(codecs[codec], "read", (uint64_t)BENCH_ENTRIES * BENCH_PASSES,
+         total * BENCH_PASSES, elapsed);
+
+  ba_reader_free(&rd);
+
+  return 0;
+}
+
+int main(void) {
+  int failed = 0;
+  for (uint32_t codec = BA_CODEC_DEFLATE; codec <= BA_CODEC_STORE; codec++) {
+    if (run(codec) < 0) {
+      perror("bench_small");
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
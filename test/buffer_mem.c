@@ -0,0 +1,152 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 40
+
+static int write_archive(ba_buffer_t *buf, uint8_t **expect) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write(wr, buf);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_data(const void *ptr, uint64_t size, uint8_t **expect) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init_mem(&buf, ptr, size) < 0)
+    return -1;
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_reader_open(rd, buf) < 0) {
+    ba_reader_free(&rd);
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  ba_buffer_free(&buf);
+
+  int ret = fixture_check(rd, expect, TEST_ENTRIES);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_detach(uint8_t **expect) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0)
+    return -1;
+
+  void *ptr = NULL;
+  uint64_t size = 0;
+  if (ba_buffer_reserve(buf, 0x100000) < 0 || write_archive(buf, expect) < 0 ||
+      ba_buffer_shrink_to_fit(buf) < 0 ||
+      ba_buffer_detach(buf, &ptr, &size) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  /* The buffer is empty after a detach and can be written again. */
+  int ret = ba_buffer_size(buf) == 0 && ba_buffer_tell(buf) == 0 ? 0 : -1;
+  if (ret == 0 && (write_archive(buf, expect) < 0 ||
+                   ba_buffer_size(buf) != size))
+    ret = -1;
+  ba_buffer_free(&buf);
+
+  if (ret == 0)
+    ret = check_data(ptr, size, expect);
+  ba_buffer_free_data(ptr);
+
+  return ret;
+}
+
+static int check_seek(void) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0)
+    return -1;
+
+  static const uint8_t tail[] = {1, 2, 3, 4};
+  uint8_t data[0x1000 + sizeof(tail)];
+
+  int ret = ba_buffer_reserve(buf, 16) < 0 || ba_buffer_shrink_to_fit(buf) < 0 ||
+                    ba_buffer_seek(buf, 0x1000, SEEK_SET) < 0 ||
+                    ba_buffer_write(buf, tail, sizeof(tail)) < 0 ||
+                    ba_buffer_shrink_to_fit(buf) < 0 ||
+                    ba_buffer_pread(buf, data, sizeof(data), 0) != sizeof(data)
+                ? -1
+                : 0;
+
+  for (uint32_t i = 0; ret == 0 && i < 0x1000; i++) {
+    if (data[i] != 0)
+      ret = -1;
+  }
+
+  if (ret == 0 && memcmp(&data[0x1000], tail, sizeof(tail)) != 0)
+    ret = -1;
+
+  ba_buffer_free(&buf);
+
+  return ret;
+}
+
+static int check_file(const char *filename) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "wb") < 0)
+    return -1;
+
+  void *ptr;
+  uint64_t size;
+  int ret = ba_buffer_reserve(buf, 16) == 0 || errno != EOPNOTSUPP ||
+                    ba_buffer_shrink_to_fit(buf) == 0 || errno != EOPNOTSUPP ||
+                    ba_buffer_detach(buf, &ptr, &size) == 0 ||
+                    errno != EOPNOTSUPP
+                ? -1
+                : 0;
+  ba_buffer_free(&buf);
+
+  return ret;
+}
+
+int main(void) {
+  const char *filename = "buffer_mem.ba";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  int failed = 0;
+  if (check_detach(expect) < 0) {
+    fprintf(stderr, "detach: FAILED\n");
+    failed = 1;
+  } else if (check_seek() < 0) {
+    fprintf(stderr, "seek past the end: FAILED\n");
+    failed = 1;
+  } else if (check_file(filename) < 0) {
+    fprintf(stderr, "file buffer: FAILED\n");
+    failed = 1;
+  }
+
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
@@ -0,0 +1,142 @@
+#ifndef BA_TEST_FIXTURE_H
+#define BA_TEST_FIXTURE_H
+
+#include <ba/ba.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FIXTURE_BLOCK_SIZE 0x10000
+#define FIXTURE_SOLID_SIZE 0x8000
+
+static inline uint64_t fixture_size(uint32_t id) {
+  if (id % 8 == 0)
+    return 0x40000 + id * 0x1000;
+  if (id % 3 == 0)
+    return 0x3000 + id * 17;
+  return 64 + id * 37;
+}
+
+static inline void fixture_name(uint32_t id, char *name, size_t len) {
+  snprintf(name, len, "entry/%u", id);
+}
+
+static inline void fixture_fill(uint32_t id, uint8_t *ptr, uint64_t size) {
+  uint32_t x = id * 2654435761u + 1;
+  for (uint64_t i = 0; i < size; i++) {
+    x = x * 1103515245u + 12345u;
+    ptr[i] = "abcdefghijklmnop"[(x >> 16) & (id % 2 ? 15 : 3)];
+  }
+}
+
+static inline uint8_t **fixture_expect(uint32_t count) {
+  uint8_t **expect = calloc(count, sizeof(*expect));
+  if (expect == NULL)
+    return NULL;
+
+  for (uint32_t id = 0; id < count; id++) {
+    uint64_t size = fixture_size(id);
+    expect[id] = malloc(size);
+    if (expect[id] == NULL) {
+      while (id-- > 0)
+        free(expect[id]);
+      free(expect);
+      return NULL;
+    }
+    fixture_fill(id, expect[id], size);
+  }
+
+  return expect;
+}
+
+static inline void fixture_free(uint8_t **expect, uint32_t count) {
+  for (uint32_t id = 0; id < count; id++)
+    free(expect[id]);
+  free(expect);
+}
+
+static inline int fixture_add(ba_writer_t *wr, uint8_t **expect,
+                              uint32_t count) {
+  for (uint32_t id = 0; id < count; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, expect[id], fixture_size(id)) < 0)
+      return -1;
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static inline int fixture_check(ba_reader_t *rd, uint8_t **expect,
+                                uint32_t count) {
+  uint64_t max = 0;
+  for (uint32_t id = 0; id < count; id++)
+    max = fixture_size(id) > max ? fixture_size(id) : max;
+
+  uint8_t *scratch = malloc(max);
+  if (scratch == NULL)
+    return -1;
+
+  int ret = 0;
+  for (uint32_t id = 0; ret == 0 && id < count; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    uint64_t size = fixture_size(id);
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_entry_size(rd, eid) != size ||
+        ba_reader_read(rd, eid, scratch) < 0 ||
+        memcmp(scratch, expect[id], size) != 0)
+      ret = -1;
+  }
+
+  free(scratch);
+
+  return ret;
+}
+
+static inline int fixture_check_file(const char *filename, uint32_t flags,
+                                     uint8_t **expect, uint32_t count) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file_ex(rd, filename, flags) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  int ret = fixture_check(rd, expect, count);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static inline int fixture_write(const char *filename, uint8_t **expect,
+                                uint32_t count) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, count) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+#endif
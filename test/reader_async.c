@@ -0,0 +1,299 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 64
+#define TEST_ROUNDS 4
+#define TEST_THREADS 3
+#define TEST_QUEUED 16
+
+struct state {
+  ba_mutex_t lock;
+  ba_cond_t cond;
+  uint8_t **expect;
+  uint32_t calls;
+  uint32_t failed;
+  int entered;
+  int open;
+};
+
+struct slot {
+  struct state *st;
+  uint8_t *ptr;
+  ba_read_request_t *req;
+  int err;
+};
+
+static void on_read(void *arg, ba_id_t id, int err) {
+  struct slot *slot = arg;
+  struct state *st = slot->st;
+
+  int bad = err != slot->err ||
+            (err == 0 &&
+             memcmp(slot->ptr, st->expect[id], fixture_size(id)) != 0);
+
+  ba_mutex_lock(&st->lock);
+  st->calls++;
+  st->failed += bad;
+  ba_cond_broadcast(&st->cond);
+  ba_mutex_unlock(&st->lock);
+}
+
+static void on_gate(void *arg, ba_id_t id, int err) {
+  struct slot *slot = arg;
+  struct state *st = slot->st;
+  (void)id;
+  (void)err;
+
+  ba_mutex_lock(&st->lock);
+  st->entered = 1;
+  ba_cond_broadcast(&st->cond);
+  while (!st->open)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+}
+
+static void wait_calls(struct state *st, uint32_t calls) {
+  ba_mutex_lock(&st->lock);
+  while (st->calls < calls)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+}
+
+static int alloc_slots(struct slot *slots, uint32_t count, struct state *st) {
+  for (uint32_t id = 0; id < count; id++) {
+    slots[id].st = st;
+    slots[id].req = NULL;
+    slots[id].err = 0;
+    slots[id].ptr = malloc(fixture_size(id));
+    if (slots[id].ptr == NULL)
+      return -1;
+  }
+
+  return 0;
+}
+
+static void free_slots(struct slot *slots, uint32_t count) {
+  for (uint32_t id = 0; id < count; id++) {
+    if (slots[id].req != NULL)
+      ba_read_request_free(&slots[id].req);
+    free(slots[id].ptr);
+  }
+}
+
+static int check_reads(ba_reader_t *rd, struct state *st) {
+  struct slot slots[TEST_ENTRIES] = {0};
+  int ret = alloc_slots(slots, TEST_ENTRIES, st);
+
+  st->calls = 0;
+  uint32_t calls = 0;
+  for (uint32_t round = 0; ret == 0 && round < TEST_ROUNDS; round++) {
+    for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+      struct slot *slot = &slots[id];
+      uint32_t mode = (id + round) % 3;
+      if (ba_reader_read_async(rd, id, slot->ptr, mode == 1 ? NULL : on_read,
+                               slot, mode == 0 ? NULL : &slot->req) < 0)
+        ret = -1;
+      calls += mode != 1;
+    }
+
+    for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+      struct slot *slot = &slots[id];
+      if (slot->req == NULL)
+        continue;
+
+      while (ba_read_request_poll(slot->req) == 0)
+        ;
+
+      if (ba_read_request_wait(slot->req) < 0 ||
+          memcmp(slot->ptr, st->expect[id], fixture_size(id)) != 0)
+        ret = -1;
+      ba_read_request_free(&slot->req);
+    }
+
+    wait_calls(st, calls);
+  }
+
+  free_slots(slots, TEST_ENTRIES);
+
+  return ret;
+}
+
+static int check_cancel(ba_reader_t *rd, struct state *st) {
+  struct slot slots[TEST_QUEUED + 1] = {0};
+  struct slot *gate = &slots[TEST_QUEUED];
+  int ret = alloc_slots(slots, TEST_QUEUED + 1, st);
+
+  st->entered = 0;
+  st->open = 0;
+  st->calls = 0;
+
+  if (ret == 0 && ba_reader_read_async(rd, TEST_QUEUED, gate->ptr, on_gate,
+                                       gate, &gate->req) < 0)
+    ret = -1;
+
+  ba_mutex_lock(&st->lock);
+  while (ret == 0 && !st->entered)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+
+  for (uint32_t id = 0; ret == 0 && id < TEST_QUEUED; id++) {
+    if (ba_reader_read_async(rd, id, slots[id].ptr, on_read, &slots[id],
+                             &slots[id].req) < 0)
+      ret = -1;
+  }
+
+  for (uint32_t id = 1; ret == 0 && id < TEST_QUEUED; id += 2) {
+    slots[id].err = ECANCELED;
+    if (ba_read_request_cancel(slots[id].req) < 0)
+      ret = -1;
+  }
+
+  if (ret == 0 &&
+      (ba_read_request_cancel(gate->req) == 0 || errno != EBUSY))
+    ret = -1;
+
+  ba_mutex_lock(&st->lock);
+  st->open = 1;
+  ba_cond_broadcast(&st->cond);
+  ba_mutex_unlock(&st->lock);
+
+  for (uint32_t id = 0; ret == 0 && id <= TEST_QUEUED; id++) {
+    int err = ba_read_request_wait(slots[id].req) < 0 ? errno : 0;
+    if (err != slots[id].err)
+      ret = -1;
+  }
+
+  if (ret == 0 && (ba_read_request_cancel(slots[0].req) == 0 ||
+                   errno != EBUSY))
+    ret = -1;
+
+  free_slots(slots, TEST_QUEUED + 1);
+
+  if (ret == 0 && (st->calls != TEST_QUEUED || st->failed != 0))
+    ret = -1;
+
+  return ret;
+}
+
+static int check_free(ba_reader_t *rd, struct state *st) {
+  struct slot slots[TEST_ENTRIES] = {0};
+  int ret = alloc_slots(slots, TEST_ENTRIES, st);
+
+  st->calls = 0;
+  for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+    if (ba_reader_read_async(rd, id, slots[id].ptr, on_read, &slots[id],
+                             NULL) < 0)
+      ret = -1;
+  }
+
+  ba_reader_free(&rd);
+
+  if (ret == 0 && (st->calls != TEST_ENTRIES || st->failed != 0))
+    ret = -1;
+
+  free_slots(slots, TEST_ENTRIES);
+
+  return ret;
+}
+
+static ba_reader_t *open_reader(const char *filename, uint32_t flags,
+                                uint32_t threads) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return NULL;
+
+  if (ba_reader_open_file_ex(rd, filename, flags) < 0 ||
+      ba_reader_set_threads(rd, threads) < 0) {
+    ba_reader_free(&rd);
+    return NULL;
+  }
+
+  return rd;
+}
+
+static int check_archive(const char *filename, uint32_t flags,
+                         struct state *st) {
+  uint64_t completed, canceled, late, merged;
+
+  ba_reader_t *rd = open_reader(filename, flags, TEST_THREADS);
+  if (rd == NULL)
+    return -1;
+
+  int ret = check_reads(rd, st);
+  if (ret == 0 &&
+      (ba_reader_async_stats(rd, &completed, &canceled, &late, &merged) < 0 ||
+       completed != TEST_ENTRIES * TEST_ROUNDS || canceled != 0))
+    ret = -1;
+  ba_reader_free(&rd);
+
+  if (ret < 0) {
+    fprintf(stderr, "reads, flags %u: FAILED\n", flags);
+    return -1;
+  }
+
+  rd = open_reader(filename, flags, 1);
+  if (rd == NULL)
+    return -1;
+
+  ret = check_cancel(rd, st);
+  if (ret == 0 &&
+      (ba_reader_async_stats(rd, &completed, &canceled, &late, &merged) < 0 ||
+       canceled != TEST_QUEUED / 2 ||
+       completed != TEST_QUEUED / 2 + 1))
+    ret = -1;
+  ba_reader_free(&rd);
+
+  if (ret < 0) {
+    fprintf(stderr, "cancel, flags %u: FAILED\n", flags);
+    return -1;
+  }
+
+  rd = open_reader(filename, flags, TEST_THREADS);
+  if (rd == NULL)
+    return -1;
+
+  if (check_free(rd, st) < 0) {
+    fprintf(stderr, "free with reads queued, flags %u: FAILED\n", flags);
+    return -1;
+  }
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "reader_async.ba";
+
+  struct state st = {0};
+  st.expect = fixture_expect(TEST_ENTRIES);
+  if (st.expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  if (ba_mutex_init(&st.lock) < 0 || ba_cond_init(&st.cond) < 0) {
+    perror("ba_mutex_init");
+    fixture_free(st.expect, TEST_ENTRIES);
+    return 1;
+  }
+
+  int failed = 0;
+  if (fixture_write(filename, st.expect, TEST_ENTRIES) < 0) {
+    perror(filename);
+    failed = 1;
+  } else {
+    failed = check_archive(filename, 0, &st) < 0 ||
+             check_archive(filename, BA_READER_LAZY, &st) < 0;
+  }
+
+  remove(filename);
+  ba_cond_destroy(&st.cond);
+  ba_mutex_destroy(&st.lock);
+  fixture_free(st.expect, TEST_ENTRIES);
+
+  return failed;
+}
@@ -0,0 +1,292 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 64
+#define TEST_SIZE 0x2000
+#define TEST_GATE (TEST_ENTRIES - 1)
+#define TEST_QUEUED 32
+
+struct state {
+  ba_mutex_t lock;
+  ba_cond_t cond;
+  uint8_t *data[TEST_ENTRIES];
+  ba_id_t log[TEST_ENTRIES];
+  uint32_t calls;
+  uint32_t failed;
+  int entered;
+  int open;
+};
+
+struct order {
+  int32_t priority;
+  uint32_t timeout;
+  uint32_t seq;
+};
+
+static void on_read(void *arg, ba_id_t id, int err) {
+  struct state *st = arg;
+
+  uint8_t expect[TEST_SIZE];
+  fixture_fill(id, expect, TEST_SIZE);
+  int bad = err != 0 || memcmp(st->data[id], expect, TEST_SIZE) != 0;
+
+  ba_mutex_lock(&st->lock);
+  if (st->calls < TEST_ENTRIES)
+    st->log[st->calls] = id;
+  st->calls++;
+  st->failed += bad;
+  ba_cond_broadcast(&st->cond);
+  ba_mutex_unlock(&st->lock);
+}
+
+static void on_gate(void *arg, ba_id_t id, int err) {
+  struct state *st = arg;
+  (void)id;
+  (void)err;
+
+  ba_mutex_lock(&st->lock);
+  st->entered = 1;
+  ba_cond_broadcast(&st->cond);
+  while (!st->open)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+}
+
+/* Parks the only worker in the gate callback, so that everything queued
+ * after this returns is scheduled in one go once the gate opens. */
+static int close_gate(ba_reader_t *rd, struct state *st) {
+  st->entered = 0;
+  st->open = 0;
+  st->calls = 0;
+  st->failed = 0;
+
+  if (ba_reader_read_async(rd, TEST_GATE, st->data[TEST_GATE], on_gate, st,
+                           NULL) < 0)
+    return -1;
+
+  ba_mutex_lock(&st->lock);
+  while (!st->entered)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+
+  return 0;
+}
+
+static void open_gate(struct state *st, uint32_t calls) {
+  ba_mutex_lock(&st->lock);
+  st->open = 1;
+  ba_cond_broadcast(&st->cond);
+  while (st->calls < calls)
+    ba_cond_wait(&st->cond, &st->lock);
+  ba_mutex_unlock(&st->lock);
+}
+
+static int order_before(const struct order *a, const struct order *b) {
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+
+  uint64_t ta = a->timeout ? a->timeout : UINT64_MAX;
+  uint64_t tb = b->timeout ? b->timeout : UINT64_MAX;
+  if (ta != tb)
+    return ta < tb;
+
+  return a->seq < b->seq;
+}
+
+static int check_order(ba_reader_t *rd, struct state *st) {
+  struct order orders[TEST_QUEUED];
+  ba_read_request_t *reqs[TEST_QUEUED] = {0};
+
+  if (close_gate(rd, st) < 0)
+    return -1;
+
+  /* Even ids only, so no two payloads are close enough to be merged. */
+  int ret = 0;
+  for (uint32_t n = 0; ret == 0 && n < TEST_QUEUED; n++) {
+    orders[n].priority = (int32_t)(n * 5 % 3) - 1;
+    orders[n].timeout = n % 4 == 0 ? 0 : (n * 7 % 5 + 1) * 1000;
+    orders[n].seq = n;
+    if (ba_reader_read_async_ex(rd, 2 * n, st->data[2 * n],
+                                orders[n].priority, orders[n].timeout, on_read,
+                                st, &reqs[n]) < 0)
+      ret = -1;
+  }
+
+  orders[TEST_QUEUED - 1].priority = 9;
+  if (ret == 0 && ba_read_request_set_priority(reqs[TEST_QUEUED - 1], 9) < 0)
+    ret = -1;
+
+  open_gate(st, ret == 0 ? TEST_QUEUED : 0);
+
+  for (uint32_t n = 0; n < TEST_QUEUED; n++) {
+    if (reqs[n] != NULL)
+      ba_read_request_free(&reqs[n]);
+  }
+
+  if (ret < 0 || st->failed != 0)
+    return -1;
+
+  uint8_t used[TEST_QUEUED] = {0};
+  for (uint32_t pos = 0; pos < TEST_QUEUED; pos++) {
+    uint32_t best = TEST_QUEUED;
+    for (uint32_t n = 0; n < TEST_QUEUED; n++) {
+      if (!used[n] &&
+          (best == TEST_QUEUED || order_before(&orders[n], &orders[best])))
+        best = n;
+    }
+    used[best] = 1;
+
+    if (st->log[pos] != 2 * best) {
+      fprintf(stderr, "read %u was id %u, expected %u\n", pos, st->log[pos],
+              2 * best);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int check_late(ba_reader_t *rd, struct state *st) {
+  if (close_gate(rd, st) < 0)
+    return -1;
+
+  int ret = ba_reader_read_async_ex(rd, 0, st->data[0], 0, 1, on_read, st,
+                                    NULL);
+  uint64_t now = ba_time_ms();
+  while (ba_time_ms() <= now + 1)
+    ;
+
+  open_gate(st, ret == 0 ? 1 : 0);
+
+  return ret == 0 && st->failed == 0 ? 0 : -1;
+}
+
+static int check_merge(ba_reader_t *rd, struct state *st) {
+  if (close_gate(rd, st) < 0)
+    return -1;
+
+  int ret = 0;
+  for (uint32_t id = 0; ret == 0 && id < TEST_QUEUED; id++) {
+    if (ba_reader_read_async(rd, id, st->data[id], on_read, st, NULL) < 0)
+      ret = -1;
+  }
+
+  open_gate(st, ret == 0 ? TEST_QUEUED : 0);
+
+  return ret == 0 && st->failed == 0 ? 0 : -1;
+}
+
+static int write_archive(const char *filename) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_codec(wr, BA_CODEC_STORE, -1) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  uint8_t data[TEST_SIZE];
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+    fixture_fill(id, data, TEST_SIZE);
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, data, TEST_SIZE) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_archive(const char *filename, uint32_t flags,
+                         struct state *st) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file_ex(rd, filename, flags) < 0 ||
+      ba_reader_set_threads(rd, 1) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  uint64_t completed, canceled, late = 0, merged = 0;
+  int ret = check_order(rd, st) < 0 ||
+                    ba_reader_async_stats(rd, &completed, &canceled, &late,
+                                          &merged) < 0 ||
+                    late != 0 || merged != 0
+                ? -1
+                : 0;
+  if (ret < 0)
+    fprintf(stderr, "order, flags %u, late %llu, merged %llu: FAILED\n", flags,
+            (unsigned long long)late, (unsigned long long)merged);
+
+  if (ret == 0 &&
+      (check_late(rd, st) < 0 ||
+       ba_reader_async_stats(rd, &completed, &canceled, &late, &merged) < 0 ||
+       late != 1)) {
+    fprintf(stderr, "late, flags %u, late %llu: FAILED\n", flags,
+            (unsigned long long)late);
+    ret = -1;
+  }
+
+  if (ret == 0 &&
+      (check_merge(rd, st) < 0 ||
+       ba_reader_async_stats(rd, &completed, &canceled, &late, &merged) < 0 ||
+       merged != TEST_QUEUED - 1)) {
+    fprintf(stderr, "merge, flags %u, merged %llu: FAILED\n", flags,
+            (unsigned long long)merged);
+    ret = -1;
+  }
+
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+int main(void) {
+  const char *filename = "reader_schedule.ba";
+
+  struct state st = {0};
+  if (ba_mutex_init(&st.lock) < 0 || ba_cond_init(&st.cond) < 0) {
+    perror("ba_mutex_init");
+    return 1;
+  }
+
+  int failed = 0;
+  for (uint32_t id = 0; !failed && id < TEST_ENTRIES; id++)
+    failed = (st.data[id] = malloc(TEST_SIZE)) == NULL;
+
+  if (failed || write_archive(filename) < 0) {
+    perror(filename);
+    failed = 1;
+  } else {
+    failed = check_archive(filename, 0, &st) < 0 ||
+             check_archive(filename, BA_READER_LAZY, &st) < 0;
+  }
+
+  remove(filename);
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++)
+    free(st.data[id]);
+  ba_cond_destroy(&st.cond);
+  ba_mutex_destroy(&st.lock);
+
+  return failed;
+}
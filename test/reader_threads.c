@@ -0,0 +1,259 @@
+#include "fixture.h"
+#include "thread.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 96
+#define TEST_THREADS 4
+#define TEST_ROUNDS 400
+#define TEST_CACHE 0x40000
+
+#define TEST_MAPPED 0
+#define TEST_COPY 1
+#define TEST_LAZY 2
+
+struct worker {
+  ba_thread_t thread;
+  ba_reader_t *rd;
+  uint8_t **expect;
+  uint32_t seed;
+  int failed;
+};
+
+static uint32_t next_rand(uint32_t *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static int check_read(ba_reader_t *rd, ba_id_t id, const uint8_t *expect,
+                      uint64_t size, uint8_t *scratch) {
+  if (ba_reader_read(rd, id, scratch) < 0)
+    return -1;
+
+  return memcmp(scratch, expect, size) == 0 ? 0 : -1;
+}
+
+static int check_range(ba_reader_t *rd, ba_id_t id, const uint8_t *expect,
+                       uint64_t size, uint8_t *scratch, uint32_t *seed) {
+  uint64_t off = next_rand(seed) % size;
+  uint64_t len = next_rand(seed) % (size - off + 1);
+
+  if (ba_reader_read_range(rd, id, off, len, scratch) < 0)
+    return -1;
+
+  return memcmp(scratch, &expect[off], len) == 0 ? 0 : -1;
+}
+
+static int check_stream(ba_reader_t *rd, ba_id_t id, const uint8_t *expect,
+                        uint64_t size, uint8_t *scratch, uint32_t *seed) {
+  ba_entry_stream_t *st;
+  if (ba_entry_stream_open(rd, id, &st) < 0)
+    return -1;
+
+  uint64_t off = 0;
+  for (;;) {
+    uint64_t n = ba_entry_stream_read(st, &scratch[off],
+                                      1 + next_rand(seed) % 0x3000);
+    if (n == 0)
+      break;
+    off += n;
+  }
+
+  ba_entry_stream_close(&st);
+
+  if (off != size)
+    return -1;
+
+  return memcmp(scratch, expect, size) == 0 ? 0 : -1;
+}
+
+static int check_cached(ba_reader_t *rd, ba_id_t id, const uint8_t *expect,
+                        uint64_t size) {
+  const void *ptr;
+  if (ba_reader_read_cached(rd, id, &ptr) < 0)
+    return -1;
+
+  int ret = memcmp(ptr, expect, size) == 0 ? 0 : -1;
+  ba_reader_release_cached(rd, ptr);
+
+  return ret;
+}
+
+static int check_batch(ba_reader_t *rd, uint8_t **expect, uint8_t *scratch,
+                       uint32_t *seed) {
+  ba_id_t ids[4];
+  void *ptrs[4];
+  int errs[4];
+  uint64_t off = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    ids[i] = next_rand(seed) % TEST_ENTRIES;
+    if (ids[i] % 8 == 0)
+      ids[i]++;
+    ptrs[i] = &scratch[off];
+    off += fixture_size(ids[i]);
+  }
+
+  if (ba_reader_read_batch(rd, ids, 4, ptrs, errs) < 0)
+    return -1;
+
+  for (uint32_t i = 0; i < 4; i++)
+    if (errs[i] != 0 ||
+        memcmp(ptrs[i], expect[ids[i]], fixture_size(ids[i])) != 0)
+      return -1;
+
+  return 0;
+}
+
+static void worker_main(void *arg) {
+  struct worker *wk = arg;
+
+  uint8_t *scratch = malloc(fixture_size(0) + TEST_ENTRIES * 0x1000);
+  if (scratch == NULL) {
+    wk->failed = 1;
+    return;
+  }
+
+  for (uint32_t i = 0; i < TEST_ROUNDS && !wk->failed; i++) {
+    ba_id_t id = next_rand(&wk->seed) % TEST_ENTRIES;
+    uint64_t size = fixture_size(id);
+    const uint8_t *expect = wk->expect[id];
+
+    int ret;
+    switch (next_rand(&wk->seed) % 5) {
+    case 0:
+      ret = check_read(wk->rd, id, expect, size, scratch);
+      break;
+    case 1:
+      ret = check_range(wk->rd, id, expect, size, scratch, &wk->seed);
+      break;
+    case 2:
+      ret = check_stream(wk->rd, id, expect, size, scratch, &wk->seed);
+      break;
+    case 3:
+      ret = check_cached(wk->rd, id, expect, size);
+      break;
+    default:
+      ret = check_batch(wk->rd, wk->expect, scratch, &wk->seed);
+      break;
+    }
+
+    if (ret < 0) {
+      fprintf(stderr, "entry %u failed\n", id);
+      wk->failed = 1;
+    }
+  }
+
+  free(scratch);
+}
+
+/* The budget is shared by the whole cache, so one entry as large as the
+ * budget is cached, and caching another evicts it. */
+static int check_budget(ba_reader_t *rd, uint8_t **expect) {
+  uint64_t hits = 0, misses, bytes;
+  if (ba_reader_set_cache(rd, fixture_size(8)) < 0 ||
+      check_cached(rd, 8, expect[8], fixture_size(8)) < 0 ||
+      ba_reader_cache_stats(rd, &hits, &misses, &bytes) < 0 ||
+      bytes != fixture_size(8))
+    return -1;
+
+  uint64_t last = hits;
+  if (check_cached(rd, 8, expect[8], fixture_size(8)) < 0 ||
+      ba_reader_cache_stats(rd, &hits, &misses, &bytes) < 0 ||
+      hits != last + 1)
+    return -1;
+
+  if (check_cached(rd, 1, expect[1], fixture_size(1)) < 0 ||
+      ba_reader_cache_stats(rd, &hits, &misses, &bytes) < 0 ||
+      bytes != fixture_size(1))
+    return -1;
+
+  return 0;
+}
+
+static int open_reader(ba_reader_t *rd, const char *filename, int mode) {
+  if (mode == TEST_MAPPED)
+    return ba_reader_open_file(rd, filename);
+
+  if (mode == TEST_LAZY)
+    return ba_reader_open_file_ex(rd, filename, BA_READER_LAZY);
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+
+  int ret = ba_reader_open(rd, buf);
+  ba_buffer_free(&buf);
+
+  return ret;
+}
+
+static int run_mode(const char *filename, int mode, uint8_t **expect) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (open_reader(rd, filename, mode) < 0 ||
+      ba_reader_set_cache(rd, TEST_CACHE) < 0 ||
+      ba_reader_set_threads(rd, 2) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  struct worker workers[TEST_THREADS];
+  uint32_t started = 0;
+  for (; started < TEST_THREADS; started++) {
+    struct worker *wk = &workers[started];
+    wk->rd = rd;
+    wk->expect = expect;
+    wk->seed = (mode + 1) * 7919 + started;
+    wk->failed = 0;
+    if (ba_thread_create(&wk->thread, worker_main, wk) < 0)
+      break;
+  }
+
+  int failed = started != TEST_THREADS;
+  for (uint32_t i = 0; i < started; i++) {
+    ba_thread_join(&workers[i].thread);
+    failed |= workers[i].failed;
+  }
+
+  uint64_t hits, misses, bytes;
+  if (ba_reader_cache_stats(rd, &hits, &misses, &bytes) < 0 ||
+      bytes > TEST_CACHE || check_budget(rd, expect) < 0)
+    failed = 1;
+
+  ba_reader_free(&rd);
+
+  return failed ? -1 : 0;
+}
+
+int main(void) {
+  static const char *const modes[] = {"mapped", "copy", "lazy"};
+  const char *filename = "reader_threads.ba";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  if (fixture_write(filename, expect, TEST_ENTRIES) < 0) {
+    perror(filename);
+    fixture_free(expect, TEST_ENTRIES);
+    return 1;
+  }
+
+  int failed = 0;
+  for (int mode = TEST_MAPPED; mode <= TEST_LAZY; mode++) {
+    int ret = run_mode(filename, mode, expect);
+    fprintf(stderr, "%s: %s\n", modes[mode], ret < 0 ? "FAILED" : "ok");
+    failed |= ret < 0;
+  }
+
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
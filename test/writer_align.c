@@ -0,0 +1,105 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 40
+
+static int write_archive(const char *filename, uint8_t **expect,
+                         uint64_t alignment, uint32_t codec, int trailing) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_alignment(wr, alignment) < 0 ||
+      ba_writer_set_codec(wr, codec, -1) < 0 ||
+      ba_writer_set_trailing_index(wr, trailing) < 0 ||
+      ba_writer_set_threads(wr, 2) < 0 ||
+      ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_mapped(const char *filename, uint8_t **expect,
+                        uint64_t alignment) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(rd, filename) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  int ret = 0;
+  for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    const void *ptr;
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_entry_data(rd, eid, &ptr) < 0 ||
+        memcmp(ptr, expect[id], fixture_size(id)) != 0 ||
+        (alignment > 1 && (uintptr_t)ptr % alignment != 0))
+      ret = -1;
+  }
+
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_archive(const char *filename, uint8_t **expect,
+                         uint64_t alignment, uint32_t codec, int trailing) {
+  if (write_archive(filename, expect, alignment, codec, trailing) < 0) {
+    perror(filename);
+    return -1;
+  }
+
+  if (fixture_check_file(filename, 0, expect, TEST_ENTRIES) < 0 ||
+      fixture_check_file(filename, BA_READER_LAZY, expect, TEST_ENTRIES) < 0 ||
+      (codec == BA_CODEC_STORE &&
+       check_mapped(filename, expect, alignment) < 0)) {
+    fprintf(stderr, "alignment %llu, codec %u, trailing %d: FAILED\n",
+            (unsigned long long)alignment, codec, trailing);
+    return -1;
+  }
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "writer_align.ba";
+  static const uint64_t alignments[] = {0, 64, 4096};
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  int failed = 0;
+  for (size_t i = 0; !failed && i < sizeof(alignments) / sizeof(*alignments);
+       i++) {
+    failed = check_archive(filename, expect, alignments[i], BA_CODEC_STORE,
+                           0) < 0 ||
+             check_archive(filename, expect, alignments[i], BA_CODEC_DEFLATE,
+                           0) < 0 ||
+             check_archive(filename, expect, alignments[i], BA_CODEC_DEFLATE,
+                           1) < 0;
+  }
+
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
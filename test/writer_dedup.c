@@ -0,0 +1,155 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 32
+#define TEST_SOURCE_ID 5
+
+static void copy_name(uint32_t id, char *name, size_t len) {
+  snprintf(name, len, "copy/%u", id);
+}
+
+static int write_source(const char *filename, const uint8_t *data,
+                        uint64_t size) {
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL)
+    return -1;
+
+  int ret = fwrite(data, 1, size, fp) == size;
+
+  return fclose(fp) == 0 && ret ? 0 : -1;
+}
+
+static int write_archive(const char *filename, const char *source,
+                         uint8_t **expect, int dedup) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_dedup(wr, dedup) < 0 ||
+      ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0 ||
+      ba_writer_add_file(wr, source) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    copy_name(id, name, sizeof(name));
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, expect[id], fixture_size(id)) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_copies(ba_reader_t *rd, const char *source, uint8_t **expect) {
+  uint8_t *scratch = malloc(fixture_size(TEST_ENTRIES - 8));
+  if (scratch == NULL)
+    return -1;
+
+  int ret = 0;
+  for (uint32_t id = 0; ret == 0 && id <= TEST_ENTRIES; id++) {
+    char name[32];
+    uint32_t src = id < TEST_ENTRIES ? id : TEST_SOURCE_ID;
+    if (id < TEST_ENTRIES)
+      copy_name(id, name, sizeof(name));
+    else
+      snprintf(name, sizeof(name), "%s", source);
+
+    uint64_t size = fixture_size(src);
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_entry_size(rd, eid) != size ||
+        ba_reader_read(rd, eid, scratch) < 0 ||
+        memcmp(scratch, expect[src], size) != 0)
+      ret = -1;
+  }
+
+  free(scratch);
+
+  return ret;
+}
+
+static int check_archive(const char *filename, const char *source,
+                         uint8_t **expect, int dedup, uint64_t *size) {
+  if (write_archive(filename, source, expect, dedup) < 0)
+    return -1;
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(rd, filename) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  int ret = fixture_check(rd, expect, TEST_ENTRIES) < 0 ||
+                    check_copies(rd, source, expect) < 0
+                ? -1
+                : 0;
+  uint64_t saved = ba_reader_dedup_size(rd);
+  ba_reader_free(&rd);
+
+  if (ret < 0 || (dedup ? saved == 0 : saved != 0)) {
+    fprintf(stderr, "dedup %d: %llu bytes shared: FAILED\n", dedup,
+            (unsigned long long)saved);
+    return -1;
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+  *size = ba_buffer_size(buf);
+  ba_buffer_free(&buf);
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "writer_dedup.ba";
+  const char *source = "writer_dedup.src";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  uint64_t plain = 0;
+  uint64_t shared = 0;
+  int failed = write_source(source, expect[TEST_SOURCE_ID],
+                            fixture_size(TEST_SOURCE_ID)) < 0 ||
+               check_archive(filename, source, expect, 0, &plain) < 0 ||
+               check_archive(filename, source, expect, 1, &shared) < 0;
+  if (failed) {
+    perror(filename);
+  } else if (shared * 3 > plain * 2) {
+    fprintf(stderr, "archive %llu bytes, %llu without dedup: FAILED\n",
+            (unsigned long long)shared, (unsigned long long)plain);
+    failed = 1;
+  }
+
+  remove(source);
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
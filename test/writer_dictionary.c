@@ -0,0 +1,138 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 400
+#define TEST_DICT 0x1000
+#define TEST_RECORD 1024
+
+static uint64_t make_record(uint32_t id, char *ptr) {
+  static const char *const kinds[] = {"sprite", "sound", "mesh", "font"};
+
+  int n = snprintf(ptr, TEST_RECORD,
+                   "{\"name\": \"asset_%u\", \"kind\": \"%s\", "
+                   "\"width\": %u, \"height\": %u, \"frames\": [",
+                   id, kinds[id % 4], 16 << (id % 5), 8 << (id % 3));
+  for (uint32_t i = 0; i < 4 + id % 9; i++)
+    n += snprintf(&ptr[n], TEST_RECORD - n,
+                  "{\"x\": %u, \"y\": %u, \"duration\": %u}, ",
+                  (id * 7 + i) % 256, (id * 13 + i) % 128, 40 + i * 10);
+  n += snprintf(&ptr[n], TEST_RECORD - n, "], \"loop\": %s}",
+                id % 2 ? "true" : "false");
+
+  return (uint64_t)n;
+}
+
+static int write_archive(ba_buffer_t *out, uint32_t dict, uint32_t threads,
+                         uint64_t solid) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_dictionary_size(wr, dict) < 0 ||
+      ba_writer_set_threads(wr, threads) < 0 ||
+      ba_writer_set_solid_size(wr, solid) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    char record[TEST_RECORD];
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, record, make_record(id, record)) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write(wr, out);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_entries(ba_reader_t *rd) {
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    char record[TEST_RECORD];
+    char data[TEST_RECORD];
+    uint64_t size = make_record(id, record);
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_entry_size(rd, eid) != size ||
+        ba_reader_read(rd, eid, data) < 0 || memcmp(data, record, size) != 0)
+      return -1;
+
+    if (ba_reader_read_range(rd, eid, size / 3, size / 3, data) < 0 ||
+        memcmp(data, &record[size / 3], size / 3) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int check_archive(uint32_t dict, uint32_t threads, uint64_t solid,
+                         uint64_t *size) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0)
+    return -1;
+
+  if (write_archive(buf, dict, threads, solid) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  *size = ba_buffer_size(buf);
+
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_reader_open(rd, buf) < 0) {
+    ba_reader_free(&rd);
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  ba_buffer_free(&buf);
+
+  int ret = check_entries(rd);
+  ba_reader_free(&rd);
+
+  if (ret < 0)
+    fprintf(stderr, "dictionary %u, threads %u, solid %llu: FAILED\n", dict,
+            threads, (unsigned long long)solid);
+
+  return ret;
+}
+
+int main(void) {
+  uint64_t plain, shared, parallel, solid;
+  if (check_archive(0, 1, 0, &plain) < 0 ||
+      check_archive(TEST_DICT, 1, 0, &shared) < 0 ||
+      check_archive(TEST_DICT, 3, 0, &parallel) < 0 ||
+      check_archive(TEST_DICT, 1, 0x2000, &solid) < 0)
+    return 1;
+
+  if (shared >= plain * 9 / 10 || parallel != shared) {
+    fprintf(stderr, "archive %llu bytes (%llu with threads), %llu without "
+                    "dictionary: FAILED\n",
+            (unsigned long long)shared, (unsigned long long)parallel,
+            (unsigned long long)plain);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,237 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 48
+#define TEST_TRACED 40
+
+static uint32_t traced_id(uint32_t n) { return n * 7 % TEST_ENTRIES; }
+
+static int read_buffer(ba_buffer_t *buf, uint8_t **data, uint64_t *size) {
+  *size = ba_buffer_size(buf);
+  *data = malloc(*size ? *size : 1);
+  if (*data == NULL)
+    return -1;
+
+  if (ba_buffer_seek(buf, 0, SEEK_SET) < 0 ||
+      ba_buffer_read(buf, *data, *size) != *size) {
+    free(*data);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int write_trace(const char *filename, const char *trace,
+                       uint8_t **expect) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(rd, filename) < 0 || ba_reader_set_trace(rd, 1) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  uint8_t *scratch = malloc(fixture_size(TEST_ENTRIES - 8));
+  int ret = scratch != NULL ? 0 : -1;
+  for (uint32_t n = 0; ret == 0 && n < TEST_TRACED; n++) {
+    char name[32];
+    fixture_name(traced_id(n), name, sizeof(name));
+
+    ba_id_t id = ba_reader_find_entry(rd, name, 0);
+    if (ba_reader_read(rd, id, scratch) < 0 ||
+        memcmp(scratch, expect[traced_id(n)], fixture_size(traced_id(n))) != 0)
+      ret = -1;
+
+    if (ret == 0 && n % 3 == 0 && ba_reader_read(rd, id, scratch) < 0)
+      ret = -1;
+  }
+
+  if (ret == 0)
+    ret = ba_reader_write_trace_file(rd, trace);
+
+  free(scratch);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_trace(const char *trace) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, trace, "rb") < 0)
+    return -1;
+
+  uint8_t *text;
+  uint64_t size;
+  int ret = read_buffer(buf, &text, &size);
+  ba_buffer_free(&buf);
+  if (ret < 0)
+    return -1;
+
+  uint64_t off = 0;
+  for (uint32_t n = 0; ret == 0 && n < TEST_TRACED; n++) {
+    char line[40];
+    fixture_name(traced_id(n), line, sizeof(line) - 1);
+    strcat(line, "\n");
+
+    size_t len = strlen(line);
+    if (size - off < len || memcmp(&text[off], line, len) != 0)
+      ret = -1;
+    off += len;
+  }
+
+  free(text);
+
+  return ret == 0 && off == size ? 0 : -1;
+}
+
+static ba_writer_t *make_writer(const char *trace, uint8_t **expect,
+                                uint32_t codec, uint32_t threads) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return NULL;
+
+  if (ba_writer_set_order_file(wr, trace) < 0 ||
+      ba_writer_set_codec(wr, codec, -1) < 0 ||
+      ba_writer_set_threads(wr, threads) < 0 ||
+      ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0) {
+    ba_writer_free(&wr);
+    return NULL;
+  }
+
+  return wr;
+}
+
+static int write_twice(ba_writer_t *wr, ba_buffer_t *buf) {
+  ba_buffer_t *first;
+  if (ba_buffer_init(&first) < 0)
+    return -1;
+
+  uint8_t *a = NULL, *b = NULL;
+  uint64_t a_size = 0, b_size = 0;
+  int ret = ba_writer_write(wr, first) < 0 || ba_writer_write(wr, buf) < 0 ||
+                    read_buffer(first, &a, &a_size) < 0 ||
+                    read_buffer(buf, &b, &b_size) < 0
+                ? -1
+                : 0;
+
+  if (ret == 0 && (a_size != b_size || memcmp(a, b, a_size) != 0)) {
+    fprintf(stderr, "second write differs from the first: FAILED\n");
+    ret = -1;
+  }
+
+  free(b);
+  free(a);
+  ba_buffer_free(&first);
+
+  return ret;
+}
+
+static int check_layout(ba_reader_t *rd) {
+  const uint8_t *last = NULL;
+  uint8_t seen[TEST_ENTRIES] = {0};
+
+  for (uint32_t n = 0; n < TEST_ENTRIES; n++) {
+    char name[32];
+    const char *str;
+    uint64_t len;
+    fixture_name(n, name, sizeof(name));
+    if (ba_reader_entry_name(rd, n, &str, &len) < 0 || len != strlen(name) ||
+        memcmp(str, name, len) != 0)
+      return -1;
+  }
+
+  for (uint32_t n = 0; n < TEST_ENTRIES; n++) {
+    uint32_t id = 0;
+    if (n < TEST_TRACED)
+      id = traced_id(n);
+    else
+      while (seen[id])
+        id++;
+    seen[id] = 1;
+
+    const void *ptr;
+    if (ba_reader_entry_data(rd, id, &ptr) < 0 ||
+        (last != NULL && (const uint8_t *)ptr <= last))
+      return -1;
+    last = ptr;
+  }
+
+  return 0;
+}
+
+static int check_archive(const char *trace, uint8_t **expect, uint32_t codec,
+                         uint32_t threads) {
+  ba_writer_t *wr = make_writer(trace, expect, codec, threads);
+  if (wr == NULL)
+    return -1;
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = write_twice(wr, buf);
+  ba_writer_free(&wr);
+
+  ba_reader_t *rd;
+  if (ret < 0 || ba_reader_alloc(&rd) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_reader_open(rd, buf) < 0) {
+    ba_reader_free(&rd);
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  ba_buffer_free(&buf);
+
+  ret = fixture_check(rd, expect, TEST_ENTRIES);
+  if (ret == 0 && codec == BA_CODEC_STORE)
+    ret = check_layout(rd);
+  ba_reader_free(&rd);
+
+  if (ret < 0)
+    fprintf(stderr, "codec %u, threads %u: FAILED\n", codec, threads);
+
+  return ret;
+}
+
+int main(void) {
+  const char *filename = "writer_order.ba";
+  const char *trace = "writer_order.txt";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  int failed = 0;
+  if (fixture_write(filename, expect, TEST_ENTRIES) < 0 ||
+      write_trace(filename, trace, expect) < 0) {
+    perror(filename);
+    failed = 1;
+  } else if (check_trace(trace) < 0) {
+    fprintf(stderr, "%s: FAILED\n", trace);
+    failed = 1;
+  } else {
+    failed = check_archive(trace, expect, BA_CODEC_STORE, 1) < 0 ||
+             check_archive(trace, expect, BA_CODEC_STORE, 3) < 0 ||
+             check_archive(trace, expect, BA_CODEC_DEFLATE, 1) < 0 ||
+             check_archive(trace, expect, BA_CODEC_DEFLATE, 3) < 0;
+  }
+
+  remove(trace);
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
@@ -0,0 +1,143 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TEST_ENTRIES 24
+
+static int write_archive(const char *filename, uint8_t **expect,
+                         uint32_t count) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (fixture_add(wr, expect, count) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int compact_archive(const char *filename) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  int ret = ba_writer_compact_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_stale(const char *stale) {
+  static const char text[] = "not an archive";
+
+  FILE *fp = fopen(stale, "rb");
+  if (fp == NULL)
+    return -1;
+
+  char data[sizeof(text)] = {0};
+  size_t len = fread(data, 1, sizeof(data), fp);
+  fclose(fp);
+
+  return len == sizeof(text) - 1 && memcmp(data, text, len) == 0 ? 0 : -1;
+}
+
+static int write_stale(const char *stale) {
+  FILE *fp = fopen(stale, "wb");
+  if (fp == NULL)
+    return -1;
+
+  int ret = fputs("not an archive", fp) >= 0;
+
+  return fclose(fp) == 0 && ret ? 0 : -1;
+}
+
+#ifndef _WIN32
+/* Only the archive, the link and the stale file may be left behind. */
+static int count_files(const char *prefix) {
+  DIR *dir = opendir(".");
+  if (dir == NULL)
+    return -1;
+
+  int count = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL)
+    count += strncmp(ent->d_name, prefix, strlen(prefix)) == 0;
+  closedir(dir);
+
+  return count;
+}
+
+static int check_link(const char *filename, const char *link,
+                      uint8_t **expect) {
+  remove(link);
+  if (symlink(filename, link) < 0 || chmod(filename, 0640) < 0)
+    return -1;
+
+  if (write_archive(link, expect, TEST_ENTRIES) < 0 ||
+      compact_archive(link) < 0)
+    return -1;
+
+  struct stat st;
+  if (lstat(link, &st) < 0 || !S_ISLNK(st.st_mode) ||
+      stat(filename, &st) < 0 || (st.st_mode & 0777) != 0640)
+    return -1;
+
+  return fixture_check_file(filename, 0, expect, TEST_ENTRIES);
+}
+#endif
+
+int main(void) {
+  const char *filename = "writer_replace.ba";
+  const char *stale = "writer_replace.ba.tmp";
+  const char *link = "writer_replace.link";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  int failed = 0;
+  if (write_stale(stale) < 0 ||
+      write_archive(filename, expect, TEST_ENTRIES / 2) < 0 ||
+      compact_archive(filename) < 0) {
+    perror(filename);
+    failed = 1;
+  } else if (check_stale(stale) < 0 ||
+             fixture_check_file(filename, 0, expect, TEST_ENTRIES / 2) < 0) {
+    fprintf(stderr, "%s: FAILED\n", stale);
+    failed = 1;
+  }
+
+#ifndef _WIN32
+  if (!failed && check_link(filename, link, expect) < 0) {
+    fprintf(stderr, "%s: FAILED\n", link);
+    failed = 1;
+  }
+
+  if (!failed && count_files("writer_replace.") != 3) {
+    fprintf(stderr, "temp files left behind: FAILED\n");
+    failed = 1;
+  }
+#endif
+
+  remove(link);
+  remove(stale);
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
@@ -0,0 +1,167 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 32
+#define TEST_FILES 4
+#define TEST_FILE_SIZE 0x6000
+
+static void file_name(uint32_t n, char *name, size_t len) {
+  snprintf(name, len, "writer_reuse.%u.src", n);
+}
+
+static int write_file(uint32_t n, uint32_t seed) {
+  char name[32];
+  file_name(n, name, sizeof(name));
+
+  uint8_t *data = malloc(TEST_FILE_SIZE);
+  if (data == NULL)
+    return -1;
+  fixture_fill(seed, data, TEST_FILE_SIZE);
+
+  FILE *fp = fopen(name, "wb");
+  if (fp == NULL) {
+    free(data);
+    return -1;
+  }
+
+  int ret = fwrite(data, 1, TEST_FILE_SIZE, fp) == TEST_FILE_SIZE;
+  free(data);
+
+  return fclose(fp) == 0 && ret ? 0 : -1;
+}
+
+static int write_archive(const char *filename, const char *previous,
+                         uint8_t **expect, uint32_t codec) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_codec(wr, codec, -1) < 0 ||
+      ba_writer_set_previous_file(wr, previous) < 0 ||
+      ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, FIXTURE_SOLID_SIZE) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  for (uint32_t n = 0; n < TEST_FILES; n++) {
+    char name[32];
+    file_name(n, name, sizeof(name));
+    if (ba_writer_add_file(wr, name) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_files(ba_reader_t *rd, const uint32_t *seeds) {
+  uint8_t *expect = malloc(TEST_FILE_SIZE);
+  uint8_t *data = malloc(TEST_FILE_SIZE);
+  int ret = expect != NULL && data != NULL ? 0 : -1;
+
+  for (uint32_t n = 0; ret == 0 && n < TEST_FILES; n++) {
+    char name[32];
+    file_name(n, name, sizeof(name));
+    fixture_fill(seeds[n], expect, TEST_FILE_SIZE);
+
+    ba_id_t id = ba_reader_find_entry(rd, name, 0);
+    if (id == BA_ENTRY_INVALID || ba_reader_read(rd, id, data) < 0 ||
+        memcmp(data, expect, TEST_FILE_SIZE) != 0)
+      ret = -1;
+  }
+
+  free(data);
+  free(expect);
+
+  return ret;
+}
+
+static int check_archive(const char *filename, uint8_t **expect,
+                         const uint32_t *seeds, uint64_t *size) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(rd, filename) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  int ret = fixture_check(rd, expect, TEST_ENTRIES) < 0 ||
+                    check_files(rd, seeds) < 0
+                ? -1
+                : 0;
+  ba_reader_free(&rd);
+
+  ba_buffer_t *buf;
+  if (ret < 0 || ba_buffer_init_file(&buf, filename, "rb") < 0) {
+    fprintf(stderr, "%s: FAILED\n", filename);
+    return -1;
+  }
+  *size = ba_buffer_size(buf);
+  ba_buffer_free(&buf);
+
+  return 0;
+}
+
+int main(void) {
+  const char *first = "writer_reuse.ba";
+  const char *second = "writer_reuse_next.ba";
+  const char *plain = "writer_reuse_plain.ba";
+  const char *missing = "writer_reuse_missing.ba";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  uint32_t seeds[TEST_FILES];
+  int failed = 0;
+  for (uint32_t n = 0; n < TEST_FILES && !failed; n++)
+    failed = write_file(n, seeds[n] = 100 + n) < 0;
+
+  uint64_t size;
+  failed = failed ||
+           write_archive(first, missing, expect, BA_CODEC_DEFLATE) < 0 ||
+           check_archive(first, expect, seeds, &size) < 0;
+
+  for (uint32_t id = 2; id < TEST_ENTRIES; id += 5)
+    fixture_fill(1000 + id, expect[id], fixture_size(id));
+  failed = failed || write_file(1, seeds[1] = 200) < 0;
+
+  uint64_t reused, stored;
+  failed = failed ||
+           write_archive(second, first, expect, BA_CODEC_STORE) < 0 ||
+           check_archive(second, expect, seeds, &reused) < 0 ||
+           write_archive(plain, NULL, expect, BA_CODEC_STORE) < 0 ||
+           check_archive(plain, expect, seeds, &stored) < 0;
+  if (failed) {
+    perror(first);
+  } else if (reused * 4 > stored * 3) {
+    fprintf(stderr, "archive %llu bytes, %llu stored: FAILED\n",
+            (unsigned long long)reused, (unsigned long long)stored);
+    failed = 1;
+  }
+
+  for (uint32_t n = 0; n < TEST_FILES; n++) {
+    char name[32];
+    file_name(n, name, sizeof(name));
+    remove(name);
+  }
+  remove(plain);
+  remove(second);
+  remove(first);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
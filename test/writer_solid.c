@@ -0,0 +1,195 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 64
+#define TEST_TINY 1024
+#define TEST_TINY_SIZE 64
+
+static uint64_t make_tiny(uint32_t id, char *name, size_t len, char *ptr) {
+  snprintf(name, len, "tiny/%u", id);
+  return (uint64_t)snprintf(ptr, TEST_TINY_SIZE,
+                            "tiny entry %u of the solid block test\n", id);
+}
+
+static int write_archive(const char *filename, uint8_t **expect,
+                         uint64_t solid) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  if (ba_writer_set_block_size(wr, FIXTURE_BLOCK_SIZE) < 0 ||
+      ba_writer_set_solid_size(wr, solid) < 0 ||
+      fixture_add(wr, expect, TEST_ENTRIES) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  for (uint32_t id = 0; id < TEST_TINY; id++) {
+    char name[32];
+    char data[TEST_TINY_SIZE];
+    uint64_t size = make_tiny(id, name, sizeof(name), data);
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, data, size) < 0) {
+      ba_writer_free(&wr);
+      return -1;
+    }
+
+    if (ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_buffer_free(&buf);
+      ba_writer_free(&wr);
+      return -1;
+    }
+  }
+
+  int ret = ba_writer_write_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int check_reverse(ba_reader_t *rd, uint8_t **expect, uint8_t *scratch) {
+  for (uint32_t id = TEST_ENTRIES; id-- > 0;) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    uint64_t size = fixture_size(id);
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_read(rd, eid, scratch) < 0 ||
+        memcmp(scratch, expect[id], size) != 0)
+      return -1;
+
+    if (ba_reader_read_range(rd, eid, size / 4, size / 2, scratch) < 0 ||
+        memcmp(scratch, &expect[id][size / 4], size / 2) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int check_tiny(ba_reader_t *rd) {
+  for (uint32_t id = TEST_TINY; id-- > 0;) {
+    char name[32];
+    char expect[TEST_TINY_SIZE];
+    char data[TEST_TINY_SIZE];
+    uint64_t size = make_tiny(id, name, sizeof(name), expect);
+
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (eid == BA_ENTRY_INVALID || ba_reader_entry_size(rd, eid) != size ||
+        ba_reader_read(rd, eid, data) < 0 || memcmp(data, expect, size) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int check_batch(ba_reader_t *rd, uint8_t **expect) {
+  ba_id_t ids[TEST_ENTRIES];
+  void *ptrs[TEST_ENTRIES];
+  int errs[TEST_ENTRIES];
+
+  int ret = 0;
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+
+    ids[id] = ba_reader_find_entry(rd, name, 0);
+    ptrs[id] = malloc(fixture_size(id));
+    if (ptrs[id] == NULL)
+      ret = -1;
+  }
+
+  if (ret == 0 && ba_reader_read_batch(rd, ids, TEST_ENTRIES, ptrs, errs) < 0)
+    ret = -1;
+
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    if (ret == 0 && (errs[id] != 0 ||
+                     memcmp(ptrs[id], expect[id], fixture_size(id)) != 0))
+      ret = -1;
+    free(ptrs[id]);
+  }
+
+  return ret;
+}
+
+static int check_archive(const char *filename, uint8_t **expect,
+                         uint32_t flags) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file_ex(rd, filename, flags) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  uint8_t *scratch = malloc(fixture_size(TEST_ENTRIES - 8));
+  int ret = scratch == NULL || fixture_check(rd, expect, TEST_ENTRIES) < 0 ||
+                    check_reverse(rd, expect, scratch) < 0 ||
+                    check_tiny(rd) < 0 ||
+                    check_batch(rd, expect) < 0
+                ? -1
+                : 0;
+
+  free(scratch);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_solid(const char *filename, uint8_t **expect, uint64_t solid,
+                       uint64_t *size) {
+  if (write_archive(filename, expect, solid) < 0) {
+    perror(filename);
+    return -1;
+  }
+
+  if (check_archive(filename, expect, 0) < 0 ||
+      check_archive(filename, expect, BA_READER_LAZY) < 0) {
+    fprintf(stderr, "solid size %llu: FAILED\n", (unsigned long long)solid);
+    return -1;
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0) {
+    perror(filename);
+    return -1;
+  }
+  *size = ba_buffer_size(buf);
+  ba_buffer_free(&buf);
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "writer_solid.ba";
+  static const uint64_t solids[] = {0x1000, FIXTURE_SOLID_SIZE, 0x40000};
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  uint64_t plain;
+  int failed = check_solid(filename, expect, 0, &plain) < 0;
+  for (size_t i = 0; !failed && i < sizeof(solids) / sizeof(*solids); i++) {
+    uint64_t size;
+    if (check_solid(filename, expect, solids[i], &size) < 0) {
+      failed = 1;
+    } else if (size >= plain) {
+      fprintf(stderr, "solid size %llu: %llu bytes, %llu without: FAILED\n",
+              (unsigned long long)solids[i], (unsigned long long)size,
+              (unsigned long long)plain);
+      failed = 1;
+    }
+  }
+
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}
@@ -0,0 +1,161 @@
+#include <ba/ba.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 12
+#define TEST_THREADS 4
+#define TEST_ROUNDS 50
+#define TEST_BUFFER 0x10000
+#define TEST_SIZE 0x50000
+
+static void fill_noise(uint32_t id, uint8_t *ptr, uint64_t size) {
+  uint32_t x = id * 2654435761u + 7;
+  for (uint64_t i = 0; i < size; i++) {
+    x = x * 1103515245u + 12345u;
+    ptr[i] = (uint8_t)(x >> 16);
+  }
+}
+
+static int write_source(const char *filename, uint64_t size) {
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL)
+    return -1;
+
+  for (uint64_t i = 0; i < size; i++)
+    fputc('a' + (int)(i % 7), fp);
+
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+static ba_writer_t *make_writer(const char *source, uint8_t **expect) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return NULL;
+
+  if (ba_writer_set_threads(wr, TEST_THREADS) < 0 ||
+      ba_writer_set_buffer_size(wr, TEST_BUFFER) < 0 ||
+      (source != NULL && ba_writer_add_file(wr, source) < 0)) {
+    ba_writer_free(&wr);
+    return NULL;
+  }
+
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    char name[32];
+    snprintf(name, sizeof(name), "large/%u", id);
+
+    ba_buffer_t *buf;
+    if (ba_buffer_init_mem(&buf, expect[id], TEST_SIZE + id) < 0 ||
+        ba_writer_add(wr, name, 0, buf) < 0) {
+      ba_writer_free(&wr);
+      return NULL;
+    }
+  }
+
+  return wr;
+}
+
+static int check_roundtrip(uint8_t **expect) {
+  ba_writer_t *wr = make_writer(NULL, expect);
+  if (wr == NULL)
+    return -1;
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write(wr, buf);
+  ba_writer_free(&wr);
+
+  ba_reader_t *rd;
+  if (ret < 0 || ba_reader_alloc(&rd) < 0) {
+    ba_buffer_free(&buf);
+    return -1;
+  }
+
+  if (ba_reader_open(rd, buf) < 0) {
+    ba_reader_free(&rd);
+    ba_buffer_free(&buf);
+    return -1;
+  }
+  ba_buffer_free(&buf);
+
+  uint8_t *scratch = malloc(TEST_SIZE + TEST_ENTRIES);
+  for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+    char name[32];
+    snprintf(name, sizeof(name), "large/%u", id);
+
+    ba_id_t eid = ba_reader_find_entry(rd, name, 0);
+    if (scratch == NULL || ba_reader_read(rd, eid, scratch) < 0 ||
+        memcmp(scratch, expect[id], TEST_SIZE + id) != 0)
+      ret = -1;
+  }
+
+  free(scratch);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_abort(const char *source, uint8_t **expect) {
+  if (write_source(source, 0x100) < 0)
+    return -1;
+
+  ba_writer_t *wr = make_writer(source, expect);
+  if (wr == NULL)
+    return -1;
+
+  if (write_source(source, 0x200) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  ba_buffer_t *buf;
+  if (ba_buffer_init(&buf) < 0) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  int ret = ba_writer_write(wr, buf);
+  int err = errno;
+  ba_buffer_free(&buf);
+  ba_writer_free(&wr);
+
+  return ret < 0 && err == EIO ? 0 : -1;
+}
+
+int main(void) {
+  const char *source = "writer_stream.src";
+
+  uint8_t *expect[TEST_ENTRIES];
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++) {
+    expect[id] = malloc(TEST_SIZE + id);
+    if (expect[id] == NULL) {
+      perror("malloc");
+      return 1;
+    }
+    fill_noise(id, expect[id], TEST_SIZE + id);
+  }
+
+  int failed = 0;
+  if (check_roundtrip(expect) < 0) {
+    fprintf(stderr, "roundtrip: FAILED\n");
+    failed = 1;
+  }
+
+  for (uint32_t i = 0; i < TEST_ROUNDS && !failed; i++) {
+    if (check_abort(source, expect) < 0) {
+      fprintf(stderr, "abort round %u: FAILED\n", i);
+      failed = 1;
+    }
+  }
+
+  remove(source);
+  for (uint32_t id = 0; id < TEST_ENTRIES; id++)
+    free(expect[id]);
+
+  return failed;
+}
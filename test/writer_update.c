@@ -0,0 +1,272 @@
+#include "fixture.h"
+#include <ba/ba.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ENTRIES 24
+#define TEST_PATCH_SIZE 0x2345
+
+static int read_file(const char *filename, uint8_t **data, uint64_t *size) {
+  ba_buffer_t *buf;
+  if (ba_buffer_init_file(&buf, filename, "rb") < 0)
+    return -1;
+
+  *size = ba_buffer_size(buf);
+  *data = malloc(*size ? *size : 1);
+  int ret = *data != NULL && ba_buffer_read(buf, *data, *size) == *size;
+  ba_buffer_free(&buf);
+
+  if (!ret) {
+    free(*data);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int write_parts(const char *filename, const uint8_t *head,
+                       uint64_t head_size, const uint8_t *tail,
+                       uint64_t tail_size) {
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL)
+    return -1;
+
+  int ret = fwrite(head, 1, head_size, fp) == head_size &&
+            fwrite(tail, 1, tail_size, fp) == tail_size;
+
+  return fclose(fp) == 0 && ret ? 0 : -1;
+}
+
+static void patch_name(uint32_t n, char *name, size_t len) {
+  snprintf(name, len, "patch/%u", n);
+}
+
+static int update(const char *filename, uint32_t n) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  uint8_t *data = malloc(TEST_PATCH_SIZE);
+  if (data == NULL) {
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  char name[32];
+  ba_buffer_t *buf;
+
+  fixture_fill(1000 + n, data, TEST_PATCH_SIZE);
+  fixture_name(n, name, sizeof(name));
+  if (ba_buffer_init_mem(&buf, data, TEST_PATCH_SIZE) < 0 ||
+      ba_writer_add(wr, name, 0, buf) < 0) {
+    free(data);
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  patch_name(n, name, sizeof(name));
+  if (ba_buffer_init_mem(&buf, data, TEST_PATCH_SIZE) < 0 ||
+      ba_writer_add(wr, name, 0, buf) < 0) {
+    free(data);
+    ba_writer_free(&wr);
+    return -1;
+  }
+
+  free(data);
+
+  int ret = ba_writer_update_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int compact(const char *filename) {
+  ba_writer_t *wr;
+  if (ba_writer_alloc(&wr) < 0)
+    return -1;
+
+  int ret = ba_writer_compact_file(wr, filename);
+  ba_writer_free(&wr);
+
+  return ret;
+}
+
+static int dead_size(const char *filename, uint64_t *dead) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file(rd, filename) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  *dead = ba_reader_dead_size(rd);
+  ba_reader_free(&rd);
+
+  return 0;
+}
+
+static int check_entry(ba_reader_t *rd, const char *name, const uint8_t *expect,
+                       uint64_t size, uint8_t *scratch) {
+  ba_id_t id = ba_reader_find_entry(rd, name, 0);
+  if (id == BA_ENTRY_INVALID || ba_reader_entry_size(rd, id) != size ||
+      ba_reader_read(rd, id, scratch) < 0)
+    return -1;
+
+  return memcmp(scratch, expect, size) == 0 ? 0 : -1;
+}
+
+static int check_state(const char *filename, uint32_t flags, uint8_t **expect,
+                       uint32_t updates) {
+  ba_reader_t *rd;
+  if (ba_reader_alloc(&rd) < 0)
+    return -1;
+
+  if (ba_reader_open_file_ex(rd, filename, flags) < 0) {
+    ba_reader_free(&rd);
+    return -1;
+  }
+
+  uint8_t *scratch = malloc(fixture_size(TEST_ENTRIES - 8) + 0x10000);
+  uint8_t *patch = malloc(TEST_PATCH_SIZE);
+  int ret = scratch != NULL && patch != NULL ? 0 : -1;
+
+  for (uint32_t id = 0; ret == 0 && id < TEST_ENTRIES; id++) {
+    char name[32];
+    fixture_name(id, name, sizeof(name));
+    if (id >= 1 && id <= updates) {
+      fixture_fill(1000 + id, patch, TEST_PATCH_SIZE);
+      ret = check_entry(rd, name, patch, TEST_PATCH_SIZE, scratch);
+    } else {
+      ret = check_entry(rd, name, expect[id], fixture_size(id), scratch);
+    }
+  }
+
+  for (uint32_t n = 1; ret == 0 && n <= updates + 1; n++) {
+    char name[32];
+    patch_name(n, name, sizeof(name));
+    ba_id_t id = ba_reader_find_entry(rd, name, 0);
+    if (n > updates) {
+      ret = id == BA_ENTRY_INVALID ? 0 : -1;
+    } else {
+      fixture_fill(1000 + n, patch, TEST_PATCH_SIZE);
+      ret = check_entry(rd, name, patch, TEST_PATCH_SIZE, scratch);
+    }
+  }
+
+  free(patch);
+  free(scratch);
+  ba_reader_free(&rd);
+
+  return ret;
+}
+
+static int check_both(const char *filename, uint8_t **expect,
+                      uint32_t updates) {
+  if (check_state(filename, 0, expect, updates) < 0 ||
+      check_state(filename, BA_READER_LAZY, expect, updates) < 0) {
+    fprintf(stderr, "%s: expected %u updates\n", filename, updates);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int check_crashes(const char *crashed, uint8_t **expect,
+                         const uint8_t *first, uint64_t first_size,
+                         const uint8_t *second, uint64_t second_size) {
+  if (second_size <= first_size) {
+    fprintf(stderr, "update did not append\n");
+    return -1;
+  }
+
+  uint64_t appended = second_size - first_size;
+  uint64_t cuts[] = {0, 1, 23, 24, appended / 2, appended - 24, appended - 1,
+                     appended};
+  for (size_t i = 0; i < sizeof(cuts) / sizeof(*cuts); i++) {
+    if (write_parts(crashed, first, first_size, &second[first_size],
+                    cuts[i]) < 0 ||
+        check_both(crashed, expect, 1) < 0) {
+      fprintf(stderr, "crash after %llu of %llu appended bytes: FAILED\n",
+              (unsigned long long)cuts[i], (unsigned long long)appended);
+      return -1;
+    }
+  }
+
+  if (write_parts(crashed, first, first_size, &second[first_size],
+                  appended / 2) < 0 ||
+      update(crashed, 2) < 0 || check_both(crashed, expect, 2) < 0) {
+    fprintf(stderr, "update after a crash: FAILED\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int check_compact(const char *filename, uint8_t **expect,
+                         uint64_t size) {
+  uint64_t before, after;
+  if (dead_size(filename, &before) < 0 || compact(filename) < 0 ||
+      dead_size(filename, &after) < 0) {
+    perror(filename);
+    return -1;
+  }
+
+  uint8_t *data;
+  uint64_t compacted;
+  if (read_file(filename, &data, &compacted) < 0) {
+    perror(filename);
+    return -1;
+  }
+  free(data);
+
+  if (before == 0 || after != 0 || compacted >= size ||
+      check_both(filename, expect, 2) < 0) {
+    fprintf(stderr, "compact: %llu dead bytes before, %llu after: FAILED\n",
+            (unsigned long long)before, (unsigned long long)after);
+    return -1;
+  }
+
+  return 0;
+}
+
+int main(void) {
+  const char *filename = "writer_update.ba";
+  const char *crashed = "writer_update_crashed.ba";
+
+  uint8_t **expect = fixture_expect(TEST_ENTRIES);
+  if (expect == NULL) {
+    perror("fixture_expect");
+    return 1;
+  }
+
+  uint8_t *first = NULL;
+  uint8_t *second = NULL;
+  uint64_t first_size = 0;
+  uint64_t second_size = 0;
+
+  int failed = fixture_write(filename, expect, TEST_ENTRIES) < 0 ||
+               check_both(filename, expect, 0) < 0 ||
+               update(filename, 1) < 0 ||
+               check_both(filename, expect, 1) < 0 ||
+               read_file(filename, &first, &first_size) < 0 ||
+               update(filename, 2) < 0 ||
+               check_both(filename, expect, 2) < 0 ||
+               read_file(filename, &second, &second_size) < 0;
+  if (failed)
+    perror(filename);
+  else
+    failed = check_crashes(crashed, expect, first, first_size, second,
+                           second_size) < 0 ||
+             check_compact(filename, expect, second_size) < 0;
+
+  free(second);
+  free(first);
+  remove(crashed);
+  remove(filename);
+  fixture_free(expect, TEST_ENTRIES);
+
+  return failed;
+}